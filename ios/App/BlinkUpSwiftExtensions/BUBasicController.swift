@@ -21,11 +21,23 @@ extension BUBasicController {
   Swift specific method for presenting the BlinkUp interface
   
   :param: animated       Animate the presentation of the controller
+  :param: queue          Queue the closures are called on
   :param: resignActive   Closure that is called when the BlinkUp interface reverts control
   :param: deviceResponse Closure that is called on success or failure of a device connection
   */
-  public func presentInterfaceAnimated(_ animated: Bool, resignActive: @escaping (_ resignActiveResponse: ResignActiveResponse) -> (), deviceResponse: @escaping (_ deviceResponse: DeviceResponse) -> ()) {
-    self.presentInterface(animated: animated, resignActive: BUBasicController.convertObjCResignActiveToSwift(resignActive), devicePollingDidComplete: BUBasicController.convertObjCDeviceResponseToSwift(deviceResponse))
+  public func presentInterfaceAnimated(_ animated: Bool, queue: DispatchQueue = DispatchQueue.main, resignActive: @escaping (_ resignActiveResponse: ResignActiveResponse) -> (), deviceResponse: @escaping (_ deviceResponse: DeviceResponse) -> ()) {
+    presentInterfaceAnimated(animated, stages: BUInterfaceStages(traceId: buTraceId(self)), queue: queue, resignActive: resignActive, deviceResponse: deviceResponse)
+  }
+
+  /**
+  Swift Internal presentation that reports its progress to `stages`
+  */
+  internal func presentInterfaceAnimated(_ animated: Bool, stages: BUInterfaceStages, queue: DispatchQueue, resignActive: @escaping (_ resignActiveResponse: ResignActiveResponse) -> (), deviceResponse: @escaping (_ deviceResponse: DeviceResponse) -> ()) {
+    buTrace("BUBasicController.configure", .begin)
+    BUSDK.ensureConfigured()
+    buTrace("BUBasicController.configure", .end)
+    stages.present()
+    self.presentInterface(animated: animated, resignActive: BUBasicController.convertObjCResignActiveToSwift(resignActive, queue: queue, stages: stages), devicePollingDidComplete: BUBasicController.convertObjCDeviceResponseToSwift(deviceResponse, queue: queue, stages: stages))
   }
   
   /**
@@ -60,21 +72,24 @@ extension BUBasicController {
   /**
   Swift Internal method for closure conversion
   */
-  class internal func convertObjCResignActiveToSwift (_ resignActive: @escaping (_ resignResponse: ResignActiveResponse) -> ()) -> BUResignActiveBlock! {
+  class internal func convertObjCResignActiveToSwift (_ resignActive: @escaping (_ resignResponse: ResignActiveResponse) -> (), queue: DispatchQueue = DispatchQueue.main, stages: BUInterfaceStages? = nil) -> BUResignActiveBlock! {
     let resignActiveObjC: BUResignActiveBlock = { (willRespond, userDidCancel, error) -> Void in
-      var response: ResignActiveResponse!
-      switch (willRespond, userDidCancel, error) {
-      case (_,_,let e) where e != nil:
-        response = ResignActiveResponse.error(e! as NSError)
-      case (_,true,_):
-        response = ResignActiveResponse.userCancelled
-      case (true, _, _):
-        response = ResignActiveResponse.willRespond
-      case (false, _, _):
-        response = ResignActiveResponse.willNotRespond
+      stages?.resign(willPoll: willRespond && !userDidCancel && error == nil)
+      queue.blinkUpAsync {
+        var response: ResignActiveResponse!
+        switch (willRespond, userDidCancel, error) {
+        case (_,_,let e) where e != nil:
+          response = ResignActiveResponse.error(e! as NSError)
+        case (_,true,_):
+          response = ResignActiveResponse.userCancelled
+        case (true, _, _):
+          response = ResignActiveResponse.willRespond
+        case (false, _, _):
+          response = ResignActiveResponse.willNotRespond
+        }
+        
+        resignActive(response)
       }
-      
-      resignActive(response)
     }
     
     return resignActiveObjC
@@ -83,20 +98,114 @@ extension BUBasicController {
   /**
   Swift Internal method for closure conversion
   */
-  class internal func convertObjCDeviceResponseToSwift (_ devicePollingDidComplete: @escaping (_ deviceResponse: DeviceResponse) -> ()) -> BUDevicePollingDidCompleteBlock! {
+  class internal func convertObjCDeviceResponseToSwift (_ devicePollingDidComplete: @escaping (_ deviceResponse: DeviceResponse) -> (), queue: DispatchQueue = DispatchQueue.main, stages: BUInterfaceStages? = nil) -> BUDevicePollingDidCompleteBlock! {
     let impeeDidConnectObjC: BUDevicePollingDidCompleteBlock = { (deviceInfo, timedOut, error) -> Void in
-      var deviceResponse: DeviceResponse!
-      switch (deviceInfo, timedOut, error) {
-      case (_, _, let e) where e != nil:
-        deviceResponse = DeviceResponse.error(error! as NSError)
-      case (_, true, _) :
-        deviceResponse = DeviceResponse.didNotConnect
-      case (let data, _, _):
-        deviceResponse = DeviceResponse.connected(data!)
+      stages?.complete()
+      queue.blinkUpAsync {
+        var deviceResponse: DeviceResponse!
+        switch (deviceInfo, timedOut, error) {
+        case (_, _, let e) where e != nil:
+          deviceResponse = DeviceResponse.error(error! as NSError)
+        case (_, true, _) :
+          deviceResponse = DeviceResponse.didNotConnect
+        case (let data, _, _):
+          deviceResponse = DeviceResponse.connected(data!)
+        }
+        devicePollingDidComplete(deviceResponse)
       }
-      devicePollingDidComplete(deviceResponse)
     }
     
     return impeeDidConnectObjC
   }
 }
+
+/**
+Swift Internal record of the open stages of a basic controller presentation.
+Each stage is traced once and a cancellation ends only the stages that are open.
+*/
+internal final class BUInterfaceStages {
+
+  /**
+  Swift Internal enumeration of presentation stages
+
+  - Idle:      The interface has not been presented
+  - Interface: The interface is on screen
+  - Poll:      The interface resigned and the device is being polled
+  - Ended:     The session finished or was cancelled
+  */
+  enum Stage {
+    case idle
+    case interface
+    case poll
+    case ended
+  }
+
+  private let lock = NSLock()
+  private var stage = Stage.idle
+  private let traceId: UInt64
+
+  init(traceId: UInt64) {
+    self.traceId = traceId
+  }
+
+  func present() {
+    guard transition(from: .idle, to: .interface) else {
+      return
+    }
+    buTrace("BUBasicController.session", .begin, id: traceId)
+    buTrace("BUBasicController.interface", .begin, id: traceId)
+  }
+
+  func resign(willPoll: Bool) {
+    guard transition(from: .interface, to: willPoll ? .poll : .ended) else {
+      return
+    }
+    buTrace("BUBasicController.interface", .end, id: traceId)
+    if willPoll {
+      buTrace("BUBasicController.poll", .begin, id: traceId)
+    } else {
+      buTrace("BUBasicController.session", .end, id: traceId)
+    }
+  }
+
+  func complete() {
+    guard transition(from: .poll, to: .ended) else {
+      return
+    }
+    buTrace("BUBasicController.poll", .end, id: traceId)
+    buTrace("BUBasicController.session", .end, id: traceId)
+  }
+
+  /**
+  End whichever stages are open
+
+  :returns: The stage that was open when the presentation was cancelled
+  */
+  func cancel() -> Stage {
+    lock.lock()
+    let previous = stage
+    stage = .ended
+    lock.unlock()
+    switch previous {
+    case .interface:
+      buTrace("BUBasicController.interface", .end, id: traceId)
+      buTrace("BUBasicController.session", .end, id: traceId)
+    case .poll:
+      buTrace("BUBasicController.poll", .end, id: traceId)
+      buTrace("BUBasicController.session", .end, id: traceId)
+    case .idle, .ended:
+      break
+    }
+    return previous
+  }
+
+  private func transition(from expected: Stage, to next: Stage) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    guard stage == expected else {
+      return false
+    }
+    stage = next
+    return true
+  }
+}
@@ -0,0 +1,284 @@
+//
+//  BUBatchProvisioner.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Provision a batch of devices from a single call
+
+ConfigIds for every slot are requested up front, the flashes are presented
+one after another, and each device is polled as soon as its flash completes.
+Progress is reported through one events closure. Events that arrive within
+`coalescingInterval` of each other are delivered together, so a bridge to a
+web view sends one message per interval instead of one per event.
+*/
+public final class BUBatchProvisioner {
+
+  /**
+  Swift enumeration of batch progress events. Every event carries the index
+  of the slot (network config) it belongs to.
+
+  - TokenAcquired: The ConfigId for the slot was activated
+  - FlashStarted:  The flash for the slot was presented
+  - FlashEnded:    The flash for the slot returned control
+  - PollStarted:   Polling started for the slot
+  - Completed:     The slot finished with the given device response
+  - Failed:        The slot failed before polling
+  */
+  public enum Event {
+    case tokenAcquired(slot: Int, token: String)
+    case flashStarted(slot: Int)
+    case flashEnded(slot: Int)
+    case pollStarted(slot: Int)
+    case completed(slot: Int, response: BUDevicePoller.PollerResponse)
+    case failed(slot: Int, error: NSError)
+
+    /**
+    Short dictionary form suitable for sending over a JSON bridge
+    */
+    public var compactRepresentation: [String: Any] {
+      switch self {
+      case .tokenAcquired(let slot, let token):
+        return ["s": slot, "e": "token", "t": token]
+      case .flashStarted(let slot):
+        return ["s": slot, "e": "flashStart"]
+      case .flashEnded(let slot):
+        return ["s": slot, "e": "flashEnd"]
+      case .pollStarted(let slot):
+        return ["s": slot, "e": "poll"]
+      case .completed(let slot, .responded(let deviceInfo)):
+        var event: [String: Any] = ["s": slot, "e": "device"]
+        event["id"] = deviceInfo.deviceId
+        event["url"] = deviceInfo.agentURL?.absoluteString
+        event["plan"] = deviceInfo.planId
+        event["at"] = deviceInfo.verificationDate?.timeIntervalSince1970
+        return event
+      case .completed(let slot, .timedOut):
+        return ["s": slot, "e": "timeout"]
+      case .completed(let slot, .error(let error)), .failed(let slot, let error):
+        return ["s": slot, "e": "error", "c": error.code]
+      }
+    }
+  }
+
+  /// Seconds events are buffered before being delivered together
+  public let coalescingInterval: TimeInterval
+
+  /// Number of times the events closure has been called
+  public private(set) var deliveries = 0
+
+  /// Number of events delivered
+  public private(set) var eventsDelivered = 0
+
+  private let apiKey: String
+  private let planId: String?
+  private let flashController: BUFlashController
+  private var configs = [BUNetworkConfig]()
+  private var configIds = [Int: BUConfigId]()
+  private var pollers = [Int: BUDevicePoller]()
+  private var nextFlashSlot = 0
+  private var isFlashing = false
+  private var remainingSlots = 0
+  private var isCancelled = false
+  private var isRunning = false
+  private var generation = 0
+  private var buffer = [Event]()
+  private var flushScheduled = false
+  private var eventsHandler: ((_ events: [Event]) -> ())?
+  private var completionHandler: (() -> ())?
+
+  /**
+  Create a batch provisioner. All methods must be called on the main queue.
+
+  :param: apiKey             The APIKey assigned to you from Electric Imp
+  :param: planId             An existing planId, or nil to have one generated per slot
+  :param: flashController    Flash controller used for every flash
+  :param: coalescingInterval Seconds events are buffered before being delivered together
+  */
+  public init(apiKey: String, planId: String? = nil, flashController: BUFlashController, coalescingInterval: TimeInterval = 0.1) {
+    self.apiKey = apiKey
+    self.planId = planId
+    self.flashController = flashController
+    self.coalescingInterval = coalescingInterval
+  }
+
+  /**
+  Provision one device per network config. Only one batch runs at a time;
+  call cancel before starting another.
+
+  :param: networkConfigs Network configs to flash, one per device slot
+  :param: events         Closure called on the main queue with buffered progress events
+  :param: completion     Closure called on the main queue once every slot has finished,
+    straight away for an empty batch
+
+  :returns: False if a batch is already running and nothing was started
+  */
+  @discardableResult
+  public func run(_ networkConfigs: [BUNetworkConfig], events: @escaping (_ events: [Event]) -> (), completion: (() -> ())? = nil) -> Bool {
+    guard !isRunning else {
+      return false
+    }
+    guard !networkConfigs.isEmpty else {
+      DispatchQueue.main.async {
+        completion?()
+      }
+      return true
+    }
+
+    generation += 1
+    let runGeneration = generation
+    isRunning = true
+    configs = networkConfigs
+    configIds.removeAll()
+    pollers.removeAll()
+    buffer.removeAll()
+    eventsHandler = events
+    completionHandler = completion
+    remainingSlots = networkConfigs.count
+    nextFlashSlot = 0
+    isCancelled = false
+
+    for slot in networkConfigs.indices {
+      let handler = { [weak self] (response: BUConfigId.ConfigIdResponse) -> () in
+        guard let strongSelf = self, strongSelf.generation == runGeneration else {
+          return
+        }
+        strongSelf.configIdDidRespond(slot, response: response)
+      }
+      if let planId = planId {
+        configIds[slot] = BUConfigId(apiKey: apiKey, planId: planId, handler: handler)
+      } else {
+        configIds[slot] = BUConfigId(apiKey: apiKey, handler: handler)
+      }
+    }
+    return true
+  }
+
+  /**
+  Stop the batch. Running pollers are stopped and no further events are delivered.
+  A flash already on screen completes normally.
+  */
+  public func cancel() {
+    isCancelled = true
+    isRunning = false
+    for poller in pollers.values {
+      poller.stopPolling()
+    }
+    pollers.removeAll()
+    configIds.removeAll()
+    buffer.removeAll()
+  }
+
+  private func configIdDidRespond(_ slot: Int, response: BUConfigId.ConfigIdResponse) {
+    guard !isCancelled else {
+      return
+    }
+    switch response {
+    case .activated(let configId):
+      emit(Event.tokenAcquired(slot: slot, token: configId.token))
+    case .error(let error):
+      configIds[slot] = nil
+      finish(slot, event: Event.failed(slot: slot, error: error))
+    }
+    flashNextSlot()
+  }
+
+  private func flashNextSlot() {
+    guard !isCancelled, !isFlashing, nextFlashSlot < configs.count else {
+      return
+    }
+    let slot = nextFlashSlot
+    guard let configId = configIds[slot] else {
+      // Slot failed to get a ConfigId and has already finished
+      nextFlashSlot += 1
+      flashNextSlot()
+      return
+    }
+    guard configId.isActive else {
+      // Wait for the ConfigId of the next slot in order
+      return
+    }
+
+    nextFlashSlot += 1
+    isFlashing = true
+    emit(Event.flashStarted(slot: slot))
+    let runGeneration = generation
+    flashController.presentFlashWithNetworkConfig(configs[slot], configId: configId, animated: true) { [weak self] (response) -> () in
+      guard let strongSelf = self else {
+        return
+      }
+      // A flash outlives a cancelled batch; it still frees the screen for the next one
+      strongSelf.isFlashing = false
+      if strongSelf.generation == runGeneration {
+        strongSelf.emit(Event.flashEnded(slot: slot))
+        strongSelf.flashDidEnd(slot, response: response)
+      }
+      DispatchQueue.main.async {
+        strongSelf.flashNextSlot()
+      }
+    }
+  }
+
+  private func flashDidEnd(_ slot: Int, response: BUFlashController.FlashResponse) {
+    guard !isCancelled else {
+      return
+    }
+    switch response {
+    case .error(let error):
+      finish(slot, event: Event.failed(slot: slot, error: error))
+    case .completedWithoutPoller:
+      finish(slot, event: nil)
+    case .completedWithPoller(let poller):
+      pollers[slot] = poller
+      emit(Event.pollStarted(slot: slot))
+      poller.startPollingWithHandler { [weak self] (pollerResponse) -> () in
+        self?.pollers[slot] = nil
+        self?.finish(slot, event: Event.completed(slot: slot, response: pollerResponse))
+      }
+    }
+  }
+
+  private func finish(_ slot: Int, event: Event?) {
+    guard !isCancelled else {
+      return
+    }
+    if let event = event {
+      emit(event)
+    }
+    remainingSlots -= 1
+    if remainingSlots == 0 {
+      isRunning = false
+      flush()
+      completionHandler?()
+      completionHandler = nil
+    }
+  }
+
+  private func emit(_ event: Event) {
+    buffer.append(event)
+    guard !flushScheduled else {
+      return
+    }
+    flushScheduled = true
+    DispatchQueue.main.asyncAfter(deadline: .now() + coalescingInterval) { [weak self] in
+      self?.flush()
+    }
+  }
+
+  private func flush() {
+    flushScheduled = false
+    guard !isCancelled, !buffer.isEmpty, let handler = eventsHandler else {
+      return
+    }
+    let events = buffer
+    buffer.removeAll()
+    deliveries += 1
+    eventsDelivered += events.count
+    handler(events)
+  }
+}
@@ -0,0 +1,200 @@
+//
+//  BUCancellationToken.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Cancels every stage of a BlinkUp session at once
+
+A single token can be passed to ConfigId retrieval, the flash, polling and the
+basic controller. Cancelling it stops pollers, dismisses the basic controller
+and suppresses every pending closure of the session. Cancelling is thread safe
+and only has an effect the first time.
+*/
+public final class BUCancellationToken {
+  private let lock = NSLock()
+  private var cancelled = false
+  private var nextHandlerId = 0
+  private var handlers = [Int: () -> ()]()
+
+  public init() {}
+
+  /**
+  True once cancel has been called
+  */
+  public var isCancelled: Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return cancelled
+  }
+
+  /**
+  Cancel the session. Registered handlers are called on the main queue.
+  */
+  public func cancel() {
+    lock.lock()
+    guard !cancelled else {
+      lock.unlock()
+      return
+    }
+    cancelled = true
+    let pending = Array(handlers.values)
+    handlers.removeAll()
+    lock.unlock()
+
+    DispatchQueue.main.blinkUpAsync {
+      for handler in pending {
+        handler()
+      }
+    }
+  }
+
+  /**
+  Swift Internal registration of work to run on cancellation. If the token is
+  already cancelled the handler runs immediately and nil is returned.
+  */
+  internal func register(_ handler: @escaping () -> ()) -> Int? {
+    lock.lock()
+    guard !cancelled else {
+      lock.unlock()
+      DispatchQueue.main.blinkUpAsync(handler)
+      return nil
+    }
+    nextHandlerId += 1
+    let handlerId = nextHandlerId
+    handlers[handlerId] = handler
+    lock.unlock()
+    return handlerId
+  }
+
+  /**
+  Swift Internal removal of a handler once its stage has completed
+  */
+  internal func unregister(_ handlerId: Int?) {
+    guard let handlerId = handlerId else {
+      return
+    }
+    lock.lock()
+    handlers[handlerId] = nil
+    lock.unlock()
+  }
+}
+
+extension BUConfigId {
+
+  /**
+  Swift specific initializer that stops reporting once the token is cancelled
+
+  The SDK request cannot be interrupted, so its result is discarded if the
+  token was cancelled before it arrived.
+
+  :param: apiKey            The APIKey assigned to you from Electric Imp
+  :param: planId            An existing planId, or nil to have one generated
+  :param: cancellationToken Token that cancels the session
+  :param: queue             Queue the handler is called on
+  :param: handler           Closure called when the configuration id is
+    retrieved, unless the token has been cancelled
+
+  :returns: ConfigId that may or may not be active
+  */
+  convenience public init(apiKey:String, planId:String? = nil, cancellationToken: BUCancellationToken, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    let guardedHandler = { (response: ConfigIdResponse) -> () in
+      if !cancellationToken.isCancelled {
+        handler(response)
+      }
+    }
+    if let planId = planId {
+      self.init(apiKey: apiKey, planId: planId, queue: queue, handler: guardedHandler)
+    } else {
+      self.init(apiKey: apiKey, queue: queue, handler: guardedHandler)
+    }
+  }
+}
+
+extension BUFlashController {
+
+  /**
+  Swift specific method for performing a BlinkUp that honours a cancellation token
+
+  A flash on screen cannot be interrupted. If the token is cancelled before
+  the flash is presented nothing is shown, and if it is cancelled during the
+  flash the resulting poller is not returned and resignActive is not called.
+
+  :param: networkConfig     The WifiConfig, WpsConfig, or ClearConfig that is to
+    be performed.
+  :param: configId          The single use configId for this flashing session
+  :param: animated          Should the presentation be animated
+  :param: cancellationToken Token that cancels the session
+  :param: queue             Queue the closure is called on
+  :param: resignActive      Closure that is executed when the BlinkUp screen is
+    dismissed, unless the token has been cancelled
+  */
+  public func presentFlashWithNetworkConfig (_ networkConfig: BUNetworkConfig, configId:BUConfigId?, animated:Bool, cancellationToken: BUCancellationToken, queue: DispatchQueue = DispatchQueue.main, resignActive :@escaping (_ flashResponse: FlashResponse) -> () )
+  {
+    guard !cancellationToken.isCancelled else {
+      return
+    }
+    self.presentFlashWithNetworkConfig(networkConfig, configId: configId, animated: animated, queue: queue) { (response) -> () in
+      if !cancellationToken.isCancelled {
+        resignActive(response)
+      }
+    }
+  }
+}
+
+extension BUBasicController {
+
+  /**
+  Swift specific method for presenting the BlinkUp interface that honours a cancellation token
+
+  Cancelling the token dismisses the interface with forceDismiss if it is on
+  screen and stops the device poller if one is running. Neither closure is
+  called afterwards.
+
+  :param: animated          Animate the presentation of the controller
+  :param: cancellationToken Token that cancels the session
+  :param: queue             Queue the closures are called on
+  :param: resignActive      Closure that is called when the BlinkUp interface reverts control
+  :param: deviceResponse    Closure that is called on success or failure of a device connection
+  */
+  public func presentInterfaceAnimated(_ animated: Bool, cancellationToken: BUCancellationToken, queue: DispatchQueue = DispatchQueue.main, resignActive: @escaping (_ resignActiveResponse: ResignActiveResponse) -> (), deviceResponse: @escaping (_ deviceResponse: DeviceResponse) -> ()) {
+    let stages = BUInterfaceStages(traceId: buTraceId(self))
+    let handlerId = cancellationToken.register { [weak self] in
+      // Only what was started is stopped, and its trace stages are closed here
+      // because the SDK callbacks are not traced after this
+      switch stages.cancel() {
+      case .interface:
+        self?.devicePoller?.stopPolling()
+        self?.forceDismiss(completionHandler: nil)
+      case .poll:
+        self?.devicePoller?.stopPolling()
+      case .idle, .ended:
+        break
+      }
+    }
+    guard !cancellationToken.isCancelled else {
+      return
+    }
+    self.presentInterfaceAnimated(animated, stages: stages, queue: queue, resignActive: { (response) -> () in
+      switch response {
+      case .willRespond:
+        break
+      default:
+        cancellationToken.unregister(handlerId)
+      }
+      if !cancellationToken.isCancelled {
+        resignActive(response)
+      }
+    }, deviceResponse: { (response) -> () in
+      cancellationToken.unregister(handlerId)
+      if !cancellationToken.isCancelled {
+        deviceResponse(response)
+      }
+    })
+  }
+}
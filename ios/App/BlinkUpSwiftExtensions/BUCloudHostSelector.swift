@@ -0,0 +1,382 @@
+//
+//  BUCloudHostSelector.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+A private impCloud host and the SSL pinning descriptions that go with it
+*/
+public struct BUCloudHost: Equatable {
+  public let hostname: String
+  public let pinningDescriptions: [BUPinningDescription]
+
+  public init(hostname: String, pinningDescriptions: [BUPinningDescription] = []) {
+    self.hostname = hostname
+    self.pinningDescriptions = pinningDescriptions
+  }
+
+  public static func == (lhs: BUCloudHost, rhs: BUCloudHost) -> Bool {
+    return lhs.hostname == rhs.hostname
+  }
+}
+
+/**
+Chooses between several private impCloud hosts by latency and health
+
+The SDK talks to a single host at a time, so the selector configures BUSDK
+with the host it picks. Hosts are probed with a TCP connection to port 443
+and the fastest one whose circuit in `hostHealth` is not open is used.
+
+Switching host records the new configuration and applies it on the main
+thread, through `BUSDK.ensureConfigured`, before the next SDK call made by a
+Swift extension method. Applying it calls `BUSDK.resetToDefaults()` and
+configures the SDK again. BUSDK documents resetToDefaults as a testing aid and expects a single
+configure call per launch, so this relies on behaviour the SDK does not
+promise. To limit the risk the selector never switches while an SDK object
+it knows about is alive: sessions it started, and any object passed to
+`track`. Register every BUBasicController, BUFlashController, BUConfigId or
+BUDevicePoller created without the selector with `track`, otherwise a
+switch may pull the host out from under it. Do not use the selector if the
+app also configures BUSDK itself.
+
+A token issued by one host can only be polled on that host, so a session
+holds the chosen host from token activation until polling ends or is
+stopped. A switch requested while the host is held is applied once it is
+released.
+*/
+public final class BUCloudHostSelector {
+
+  /// Hosts in order of preference when no latency is known
+  public let hosts: [BUCloudHost]
+  /// Tracker whose circuits exclude failing hosts
+  public let hostHealth: BUHostHealth
+  /// Seconds allowed for each latency probe
+  public let probeTimeout: TimeInterval
+  /// A new host must be this much faster than the active one to replace it
+  public let switchMargin: Double
+
+  private struct WeakReference {
+    weak var object: AnyObject?
+  }
+
+  private let featureCodes: [String]
+  private let apiKey: String?
+  private let lock = NSLock()
+  private var measured = [String: TimeInterval]()
+  private var unreachable = Set<String>()
+  private var active: BUCloudHost?
+  private var pending: BUCloudHost?
+  private var sessions = 0
+  private var heldTokens = Set<String>()
+  private var tracked = [WeakReference]()
+
+  /**
+  :param: hosts         Hosts to choose between, in order of preference
+  :param: featureCodes  Feature codes enabled on every host
+  :param: apiKey        The API Key assigned to you from Electric Imp, required for feature codes
+  :param: hostHealth    Tracker whose circuits exclude failing hosts
+  :param: probeTimeout  Seconds allowed for each latency probe
+  :param: switchMargin  Fraction by which a host must be faster to replace the active one
+  */
+  public init(hosts: [BUCloudHost], featureCodes: [String] = [], apiKey: String? = nil, hostHealth: BUHostHealth = BUHostHealth.shared, probeTimeout: TimeInterval = 2, switchMargin: Double = 0.2) {
+    self.hosts = hosts
+    self.featureCodes = featureCodes
+    self.apiKey = apiKey
+    self.hostHealth = hostHealth
+    self.probeTimeout = probeTimeout
+    self.switchMargin = switchMargin
+  }
+
+  /**
+  Host the SDK is configured with, or nil before the first selection
+  */
+  public var activeHost: BUCloudHost? {
+    lock.lock()
+    defer { lock.unlock() }
+    return active
+  }
+
+  /**
+  Connection latency in seconds of every host that answered the last probe
+  */
+  public var latencies: [String: TimeInterval] {
+    lock.lock()
+    defer { lock.unlock() }
+    return measured
+  }
+
+  /**
+  Number of sessions currently holding the active host
+  */
+  public var activeSessions: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return sessions
+  }
+
+  /**
+  Keep the active host while an SDK object created outside the selector is alive
+
+  :param: object A BUBasicController, BUFlashController, BUConfigId or BUDevicePoller
+  */
+  public func track(_ object: AnyObject) {
+    lock.lock()
+    tracked.append(WeakReference(object: object))
+    lock.unlock()
+  }
+
+  /**
+  Probe every host and select the best one
+
+  :param: completion Closure called on the main queue with the host that is
+    or will be active once running sessions end
+  */
+  public func refresh(completion: ((_ host: BUCloudHost?) -> ())? = nil) {
+    let group = DispatchGroup()
+    for host in hosts {
+      group.enter()
+      BUConnectionProbe.connect(host: host.hostname, port: 443, timeout: probeTimeout) { (latency) -> () in
+        self.lock.lock()
+        if let latency = latency {
+          self.measured[host.hostname] = latency
+          self.unreachable.remove(host.hostname)
+        } else {
+          self.measured[host.hostname] = nil
+          self.unreachable.insert(host.hostname)
+        }
+        self.lock.unlock()
+        group.leave()
+      }
+    }
+    group.notify(queue: DispatchQueue.main) {
+      let host = self.select()
+      completion?(host)
+    }
+  }
+
+  /**
+  Abandon the active host after it failed and move to the next best one
+
+  :returns: True if the SDK now uses another host, false if there is none or
+    the switch waits for running sessions to end
+  */
+  @discardableResult
+  public func failover() -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    let previous = active
+    if let hostname = previous?.hostname {
+      measured[hostname] = nil
+      unreachable.insert(hostname)
+    }
+    selectLocked()
+    return active != previous
+  }
+
+  /**
+  Hold the active host for a session. Configures the SDK first if no host
+  has been selected yet, and applies a waiting switch if nothing holds the host.
+
+  :returns: The host the session must use until `endSession` is called
+  */
+  @discardableResult
+  public func beginSession() -> BUCloudHost? {
+    lock.lock()
+    defer { lock.unlock() }
+    if active == nil {
+      selectLocked()
+    } else {
+      applyPendingLocked()
+    }
+    sessions += 1
+    return active
+  }
+
+  /**
+  Release the host held by a session and apply any switch that was waiting for it
+  */
+  public func endSession() {
+    lock.lock()
+    sessions = max(0, sessions - 1)
+    lock.unlock()
+    applyPendingIfIdle()
+  }
+
+  /**
+  Release the host held by an activated ConfigId from `BUConfigId.retrieve(hostSelector:)`.
+  Only the first call for a token has an effect, so it is safe to call after
+  polling has already released it.
+
+  :param: token Token of the ConfigId
+  */
+  public func endSession(forConfigId token: String) {
+    lock.lock()
+    let held = heldTokens.remove(token) != nil
+    lock.unlock()
+    if held {
+      endSession()
+    }
+  }
+
+  /**
+  Swift Internal transfer of the current session to an activated ConfigId
+  */
+  internal func hold(_ configId: BUConfigId) {
+    lock.lock()
+    heldTokens.insert(configId.token)
+    lock.unlock()
+  }
+
+  private func applyPendingIfIdle() {
+    lock.lock()
+    defer { lock.unlock() }
+    applyPendingLocked()
+  }
+
+  // Must be called with the lock held
+  private func applyPendingLocked() {
+    guard let host = pending, isIdle() else {
+      return
+    }
+    pending = nil
+    active = host
+    configure(host)
+  }
+
+  // Must be called with the lock held
+  private func isIdle() -> Bool {
+    tracked.removeAll { $0.object == nil }
+    return sessions == 0 && tracked.isEmpty
+  }
+
+  @discardableResult
+  private func select() -> BUCloudHost? {
+    lock.lock()
+    defer { lock.unlock() }
+    return selectLocked()
+  }
+
+  // Must be called with the lock held
+  @discardableResult
+  private func selectLocked() -> BUCloudHost? {
+    guard let best = bestHost() else {
+      return active
+    }
+    if let current = active, best != current, isUsable(current),
+       let currentLatency = measured[current.hostname], let bestLatency = measured[best.hostname],
+       bestLatency > currentLatency * (1 - switchMargin) {
+      pending = nil
+      return current
+    }
+    guard best != active else {
+      pending = nil
+      return best
+    }
+    guard isIdle() else {
+      pending = best
+      return best
+    }
+    pending = nil
+    active = best
+    configure(best)
+    return best
+  }
+
+  // Fastest usable host, then the first usable host without a measurement,
+  // then the first host whose circuit is not open
+  private func bestHost() -> BUCloudHost? {
+    let usable = hosts.filter { isUsable($0) }
+    let timed = usable.filter { measured[$0.hostname] != nil }
+    if let fastest = timed.min(by: { measured[$0.hostname]! < measured[$1.hostname]! }) {
+      return fastest
+    }
+    return usable.first ?? hosts.first(where: { !isOpen($0) })
+  }
+
+  private func isUsable(_ host: BUCloudHost) -> Bool {
+    return !unreachable.contains(host.hostname) && !isOpen(host)
+  }
+
+  private func isOpen(_ host: BUCloudHost) -> Bool {
+    if case .open(let until) = hostHealth.state(forHost: host.hostname) {
+      return until > Date()
+    }
+    return false
+  }
+
+  // Records the host and applies it on the main thread. Every Swift extension
+  // method calls ensureConfigured before reaching the SDK, so the switch is in
+  // place by the next SDK call whichever thread requested it.
+  private func configure(_ host: BUCloudHost) {
+    let pins = host.pinningDescriptions
+    BULazyConfiguration.shared.record(BULazyConfiguration.Parameters(privateCloudHost: host.hostname, pinningDescriptions: { pins }, featureCodes: featureCodes, apiKey: apiKey, replacesConfiguration: true))
+    DispatchQueue.main.async {
+      BUSDK.ensureConfigured()
+    }
+  }
+}
+
+extension BUConfigId {
+
+  /**
+  Swift specific ConfigId retrieval that fails over between private cloud hosts
+
+  A server or network failure is recorded against the host and, while no
+  other session holds it, the request is repeated on the next best host.
+  Once activated the ConfigId holds its host; poll it with the selector in
+  `BUPollingOptions` or call `hostSelector.endSession(forConfigId:)` if it is
+  not used.
+
+  :param: apiKey       The APIKey assigned to you from Electric Imp
+  :param: planId       An existing planId, or nil to have one generated
+  :param: hostSelector Selector choosing the private cloud host
+  :param: queue        Queue the handler is called on
+  :param: handler      Closure called when the configuration id is
+    retrieved from the Electric Imp server.
+  */
+  public class func retrieve(apiKey: String, planId: String? = nil, hostSelector: BUCloudHostSelector, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    retrieve(apiKey: apiKey, planId: planId, hostSelector: hostSelector, remainingHosts: hostSelector.hosts.count - 1, queue: queue, handler: handler)
+  }
+
+  private class func retrieve(apiKey: String, planId: String?, hostSelector: BUCloudHostSelector, remainingHosts: Int, queue: DispatchQueue, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    guard let host = hostSelector.beginSession()?.hostname else {
+      hostSelector.endSession()
+      queue.async {
+        handler(ConfigIdResponse.error(BUHostHealth.circuitOpenError(forHost: BUHostHealth.currentHost)))
+      }
+      return
+    }
+
+    let completion = { (response: ConfigIdResponse) -> () in
+      guard case .error(let error) = response else {
+        if case .activated(let configId) = response {
+          hostSelector.hold(configId)
+        }
+        hostSelector.hostHealth.recordSuccess(forHost: host)
+        handler(response)
+        return
+      }
+      hostSelector.endSession()
+      guard BUHostHealth.isHostFailure(error) else {
+        handler(response)
+        return
+      }
+      hostSelector.hostHealth.recordFailure(forHost: host)
+      guard remainingHosts > 0, hostSelector.failover() else {
+        handler(response)
+        return
+      }
+      BUConfigId.retrieve(apiKey: apiKey, planId: planId, hostSelector: hostSelector, remainingHosts: remainingHosts - 1, queue: queue, handler: handler)
+    }
+    if let planId = planId {
+      _ = BUConfigId(apiKey: apiKey, planId: planId, queue: queue, handler: completion)
+    } else {
+      _ = BUConfigId(apiKey: apiKey, queue: queue, handler: completion)
+    }
+  }
+}
@@ -0,0 +1,25 @@
+//
+//  BUCompletionQueue.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+
+extension DispatchQueue {
+
+  /**
+  Swift Internal method for delivering completions on a caller selected queue
+
+  The SDK calls its blocks on the main queue. When the main queue is also the
+  requested queue the work runs inline, so the default keeps its original timing.
+  */
+  internal func blinkUpAsync(_ work: @escaping () -> ()) {
+    if self === DispatchQueue.main && Thread.isMainThread {
+      work()
+    } else {
+      self.async(execute: work)
+    }
+  }
+}
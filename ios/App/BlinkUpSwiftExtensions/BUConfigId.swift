@@ -6,6 +6,7 @@
 //  Copyright © 2020 Twilio Inc. All rights reserved.
 //
 
+import Foundation
 import BlinkUp
 
 extension BUConfigId {
@@ -14,13 +15,15 @@ extension BUConfigId {
   Swift specific initializer with automatic planId retrieval
   
   :param: apiKey  The APIKey assigned to you from Electric Imp
+  :param: queue   Queue the handler is called on
   :param: handler Closure called when the configuration id is 
     retrieved from the Electric Imp server.
   
   :returns: ConfigId that may or may not be active
   */
-  convenience public init(apiKey:String, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
-    self.init(apiKey: apiKey, completionHandler: BUConfigId.convertHandlerToObjC(handler))
+  convenience public init(apiKey:String, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    BUSDK.ensureConfigured()
+    self.init(apiKey: apiKey, completionHandler: BUConfigId.convertHandlerToObjC(handler, queue: queue))
   }
   
   /**
@@ -29,13 +32,15 @@ extension BUConfigId {
   :param: apiKey  The APIKey assigned to you from Electric Imp
   :param: planId  If setting the planId property, it must be an
     existing Id previously generated by Electric Imp
+  :param: queue   Queue the handler is called on
   :param: handler Closure called when the configuration id is
   retrieved from the Electric Imp server.
   
   :returns: ConfigId that may or may not be active
   */
-  convenience public init(apiKey:String, planId:String,handler: @escaping (_ response:ConfigIdResponse) -> ()) {
-    self.init(apiKey: apiKey, planId: planId, completionHandler: BUConfigId.convertHandlerToObjC(handler))
+  convenience public init(apiKey:String, planId:String, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    BUSDK.ensureConfigured()
+    self.init(apiKey: apiKey, planId: planId, completionHandler: BUConfigId.convertHandlerToObjC(handler, queue: queue))
   }
   
   /**
@@ -53,18 +58,20 @@ extension BUConfigId {
   /**
   Swift Internal method for closure conversion
   */
-  class internal func convertHandlerToObjC (_ handler: @escaping (_ response:ConfigIdResponse) -> ()) -> BUConfigIdCompletionHandler
+  class internal func convertHandlerToObjC (_ handler: @escaping (_ response:ConfigIdResponse) -> (), queue: DispatchQueue = DispatchQueue.main) -> BUConfigIdCompletionHandler
   {
     let objCHandler: BUConfigIdCompletionHandler = {(goodConfigId, error) -> Void in
-      var properResponse :ConfigIdResponse
-      switch (goodConfigId, error) {
-      case (_, let e) where e != nil:
-        properResponse = ConfigIdResponse.error(e! as NSError)
-      default:
-        properResponse = ConfigIdResponse.activated (activeConfig: goodConfigId)
+      queue.blinkUpAsync {
+        var properResponse :ConfigIdResponse
+        switch (goodConfigId, error) {
+        case (_, let e) where e != nil:
+          properResponse = ConfigIdResponse.error(e! as NSError)
+        default:
+          properResponse = ConfigIdResponse.activated (activeConfig: goodConfigId)
+        }
+        
+        handler(properResponse)
       }
-      
-      handler(properResponse)
     }
     
     return objCHandler
@@ -0,0 +1,119 @@
+//
+//  BUConnectionProbe.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import Network
+
+/**
+Swift Internal connection checks shared by the validator and the cloud host selector
+*/
+internal enum BUConnectionProbe {
+
+  /**
+  Open a TCP connection and close it again as soon as it is ready
+
+  :param: host       Host name or address to connect to
+  :param: port       Port to connect to
+  :param: timeout    Seconds allowed for the connection attempt
+  :param: completion Closure called on an internal queue with the seconds taken
+    to connect, or nil if the host could not be reached in time
+  */
+  static func connect(host: String, port: UInt16, timeout: TimeInterval, completion: @escaping (_ latency: TimeInterval?) -> ()) {
+    guard let endpointPort = NWEndpoint.Port(rawValue: port) else {
+      completion(nil)
+      return
+    }
+    let queue = DispatchQueue(label: "com.electricimp.blinkup.probe")
+    let connection = NWConnection(host: NWEndpoint.Host(host), port: endpointPort, using: .tcp)
+    let start = Date()
+    var finished = false
+    let finish = { (latency: TimeInterval?) -> () in
+      guard !finished else {
+        return
+      }
+      finished = true
+      connection.cancel()
+      completion(latency)
+    }
+    connection.stateUpdateHandler = { (state) -> Void in
+      switch state {
+      case .ready:
+        finish(Date().timeIntervalSince(start))
+      case .failed(_), .waiting(_):
+        finish(nil)
+      default:
+        break
+      }
+    }
+    connection.start(queue: queue)
+    queue.asyncAfter(deadline: .now() + timeout) {
+      finish(nil)
+    }
+  }
+
+  /**
+  Send a DNS query over UDP and wait for any answer from the server. Many
+  resolvers, home routers in particular, do not accept TCP on port 53.
+
+  :param: server     Address of the DNS server
+  :param: timeout    Seconds allowed for the answer
+  :param: completion Closure called on an internal queue with the seconds taken
+    to answer, or nil if the server did not answer in time
+  */
+  static func dnsQuery(server: String, timeout: TimeInterval, completion: @escaping (_ latency: TimeInterval?) -> ()) {
+    let queue = DispatchQueue(label: "com.electricimp.blinkup.probe")
+    let connection = NWConnection(host: NWEndpoint.Host(server), port: 53, using: .udp)
+    let identifier = UInt16.random(in: 0...UInt16.max)
+    // Header with recursion desired and one question, then a query for the
+    // NS records of the root zone. Any reply, even a refusal, proves the
+    // server is answering.
+    let query = Data([UInt8(identifier >> 8), UInt8(identifier & 0xff), 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                      0x00, 0x00, 0x02, 0x00, 0x01])
+    let start = Date()
+    var finished = false
+    let finish = { (latency: TimeInterval?) -> () in
+      guard !finished else {
+        return
+      }
+      finished = true
+      connection.cancel()
+      completion(latency)
+    }
+    func receive() {
+      connection.receiveMessage { (data, _, _, error) -> Void in
+        guard error == nil else {
+          finish(nil)
+          return
+        }
+        if let data = data, data.count >= 2, data[data.startIndex] == query[0], data[data.startIndex + 1] == query[1] {
+          finish(Date().timeIntervalSince(start))
+        } else {
+          receive()
+        }
+      }
+    }
+    connection.stateUpdateHandler = { (state) -> Void in
+      switch state {
+      case .ready:
+        connection.send(content: query, completion: NWConnection.SendCompletion.contentProcessed { (error) -> Void in
+          if error != nil {
+            finish(nil)
+          }
+        })
+        receive()
+      case .failed(_):
+        finish(nil)
+      default:
+        break
+      }
+    }
+    connection.start(queue: queue)
+    queue.asyncAfter(deadline: .now() + timeout) {
+      finish(nil)
+    }
+  }
+}
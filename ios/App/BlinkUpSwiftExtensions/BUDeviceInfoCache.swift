@@ -0,0 +1,194 @@
+//
+//  BUDeviceInfoCache.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Cache of verified devices keyed by configId token and deviceId
+
+Pollers started with a cache in their BUPollingOptions complete immediately
+when their configId has already been verified, and concurrent pollers for the
+same configId share a single upstream poll. Each handler is called on the
+queue given when its poller was started.
+*/
+public final class BUDeviceInfoCache {
+
+  /**
+  Cache shared by all pollers that do not supply their own
+  */
+  public static let shared = BUDeviceInfoCache()
+
+  private struct Entry {
+    let deviceInfo: BUDeviceInfo
+    let expiration: Date
+  }
+
+  private struct Waiter {
+    let poller: ObjectIdentifier
+    let handler: (_ response: BUDevicePoller.PollerResponse) -> ()
+  }
+
+  private struct Poll {
+    let stop: () -> ()
+    var waiters: [Waiter]
+  }
+
+  private let lock = NSLock()
+  private var ttl: TimeInterval
+  private var entriesByConfigId = [String: Entry]()
+  private var entriesByDeviceId = [String: Entry]()
+  private var pollsByConfigId = [String: Poll]()
+  private var hitCount = 0
+  private var missCount = 0
+  private var sharedCount = 0
+
+  /**
+  Create a cache
+
+  :param: timeToLive Seconds a verified device is kept in the cache
+  */
+  public init(timeToLive: TimeInterval = 600) {
+    self.ttl = timeToLive
+  }
+
+  /**
+  Seconds a verified device is kept in the cache. Changing the value only
+  affects devices stored afterwards.
+  */
+  public var timeToLive: TimeInterval {
+    get { return locked { ttl } }
+    set { locked { ttl = newValue } }
+  }
+
+  /**
+  Number of pollers that completed from the cache
+  */
+  public var hits: Int {
+    return locked { hitCount }
+  }
+
+  /**
+  Number of pollers that had to go to the server
+  */
+  public var misses: Int {
+    return locked { missCount }
+  }
+
+  /**
+  Number of pollers that joined a poll already in flight for their configId
+  */
+  public var sharedPolls: Int {
+    return locked { sharedCount }
+  }
+
+  /**
+  Verified device for a configId token, or nil if missing or expired
+  */
+  public func deviceInfo(forConfigId token: String) -> BUDeviceInfo? {
+    return locked { liveEntry(entriesByConfigId, token)?.deviceInfo }
+  }
+
+  /**
+  Most recently verified device with the given deviceId, or nil if missing or expired
+  */
+  public func deviceInfo(forDeviceId deviceId: String) -> BUDeviceInfo? {
+    return locked { liveEntry(entriesByDeviceId, deviceId)?.deviceInfo }
+  }
+
+  /**
+  Store a verified device for the configId token it was polled with
+  */
+  public func store(_ deviceInfo: BUDeviceInfo, forConfigId token: String) {
+    locked {
+      let entry = Entry(deviceInfo: deviceInfo, expiration: Date(timeIntervalSinceNow: ttl))
+      entriesByConfigId[token] = entry
+      if let deviceId = deviceInfo.deviceId {
+        entriesByDeviceId[deviceId] = entry
+      }
+    }
+  }
+
+  /**
+  Drop every cached device and reset the counters. Polls in flight are not affected.
+  */
+  public func removeAll() {
+    locked {
+      entriesByConfigId.removeAll()
+      entriesByDeviceId.removeAll()
+      hitCount = 0
+      missCount = 0
+      sharedCount = 0
+    }
+  }
+
+  /**
+  Internal lookup used by the poller. Returns the cached device on a hit. On a
+  miss the handler is queued and `shouldPoll` tells the caller whether it leads
+  the upstream poll for this configId, in which case `stop` must stop that poll.
+  */
+  internal func lookup(_ token: String, poller: BUDevicePoller, stop: @escaping () -> (), handler: @escaping (_ response: BUDevicePoller.PollerResponse) -> ()) -> (deviceInfo: BUDeviceInfo?, shouldPoll: Bool) {
+    return locked {
+      if let entry = liveEntry(entriesByConfigId, token) {
+        hitCount += 1
+        return (entry.deviceInfo, false)
+      }
+      let waiter = Waiter(poller: ObjectIdentifier(poller), handler: handler)
+      if pollsByConfigId[token] != nil {
+        sharedCount += 1
+        pollsByConfigId[token]!.waiters.append(waiter)
+        return (nil, false)
+      }
+      missCount += 1
+      pollsByConfigId[token] = Poll(stop: stop, waiters: [waiter])
+      return (nil, true)
+    }
+  }
+
+  /**
+  Internal completion of an upstream poll. Returns the handlers waiting on it.
+  */
+  internal func complete(_ token: String, response: BUDevicePoller.PollerResponse) -> [(_ response: BUDevicePoller.PollerResponse) -> ()] {
+    if case .responded(let deviceInfo) = response {
+      store(deviceInfo, forConfigId: token)
+    }
+    return locked { (pollsByConfigId.removeValue(forKey: token)?.waiters ?? []).map { $0.handler } }
+  }
+
+  /**
+  Internal removal of a poller from the poll for its configId. Returns the
+  closure that stops the upstream poll once no poller is left waiting on it,
+  even if the poller that started it was not the last to leave.
+  */
+  internal func leave(_ token: String, poller: BUDevicePoller) -> (() -> ())? {
+    return locked {
+      guard var poll = pollsByConfigId[token] else {
+        return nil
+      }
+      poll.waiters.removeAll { $0.poller == ObjectIdentifier(poller) }
+      guard poll.waiters.isEmpty else {
+        pollsByConfigId[token] = poll
+        return nil
+      }
+      pollsByConfigId[token] = nil
+      return poll.stop
+    }
+  }
+
+  private func liveEntry(_ entries: [String: Entry], _ key: String) -> Entry? {
+    guard let entry = entries[key], entry.expiration > Date() else {
+      return nil
+    }
+    return entry
+  }
+
+  private func locked<T>(_ body: () -> T) -> T {
+    lock.lock()
+    defer { lock.unlock() }
+    return body()
+  }
+}
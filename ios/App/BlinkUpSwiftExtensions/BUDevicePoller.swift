@@ -14,20 +14,24 @@ extension BUDevicePoller {
   /**
   Swift specific implementation for polling to see if a device connected
   
+  :param: queue           Queue the handler is called on
   :param: responseHandler Closure that is called on success or failure of a BlinkUp attempt
   */
-  public func startPollingWithHandler(_ responseHandler: @escaping (_ response:PollerResponse) -> ()) {
+  public func startPollingWithHandler(queue: DispatchQueue = DispatchQueue.main, _ responseHandler: @escaping (_ response:PollerResponse) -> ()) {
+    BUSDK.ensureConfigured()
     self.startPolling { (deviceInfo, timedOut, error) -> Void in
-      var response :PollerResponse
-      switch(deviceInfo, timedOut, error) {
-      case (_,_, let e) where e != nil:
-        response = PollerResponse.error(e! as NSError)
-      case(_,true,_):
-        response = PollerResponse.timedOut
-      default:
-        response = PollerResponse.responded(deviceInfo!)
+      queue.blinkUpAsync {
+        var response :PollerResponse
+        switch(deviceInfo, timedOut, error) {
+        case (_,_, let e) where e != nil:
+          response = PollerResponse.error(e! as NSError)
+        case(_,true,_):
+          response = PollerResponse.timedOut
+        default:
+          response = PollerResponse.responded(deviceInfo!)
+        }
+        responseHandler(response)
       }
-      responseHandler(response)
     }
   }
   
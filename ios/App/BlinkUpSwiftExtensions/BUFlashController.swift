@@ -8,8 +8,10 @@
 
 import AVFoundation
 import CoreGraphics
+import ImageIO
 import OpenGLES
 import QuartzCore
+import UIKit
 import BlinkUp
 
 extension BUFlashController {
@@ -35,23 +37,103 @@ extension BUFlashController {
   :param: configId      The single use configId for this flashing session. This
     can be nil in the case of clearing a device
   :param: animated      Should the presentation be animated
+  :param: queue         Queue the closure is called on
+  :param: releaseInterstitialImage Set interstitialImage to nil once the flash
+    returns control, so its decoded pixels are not kept alive
   :param: resignActive  Closure that is executed when the BlinkUp screen is
     dismissed and control is returned to the presenting screen
   */
-  public func presentFlashWithNetworkConfig (_ networkConfig: BUNetworkConfig, configId:BUConfigId?, animated:Bool, resignActive :@escaping (_ flashResponse: FlashResponse) -> () )
+  public func presentFlashWithNetworkConfig (_ networkConfig: BUNetworkConfig, configId:BUConfigId?, animated:Bool, queue: DispatchQueue = DispatchQueue.main, releaseInterstitialImage: Bool = false, resignActive :@escaping (_ flashResponse: FlashResponse) -> () )
   {
+    BUSDK.ensureConfigured()
     self.presentFlash(with: networkConfig, configId: configId, animated: animated) { (willRespond, poller, error) -> Void in
-      var response :FlashResponse
-      switch(willRespond, poller, error) {
-      case(_,_,let e) where e != nil:
-        response = FlashResponse.error(e! as NSError)
-      case(false, _, _):
-        response = FlashResponse.completedWithoutPoller
-      default:
-        response = FlashResponse.completedWithPoller(poller!)
+      if releaseInterstitialImage {
+        self.interstitialImage = nil
+      }
+      queue.blinkUpAsync {
+        var response :FlashResponse
+        switch(willRespond, poller, error) {
+        case(_,_,let e) where e != nil:
+          response = FlashResponse.error(e! as NSError)
+        case(false, _, _):
+          response = FlashResponse.completedWithoutPoller
+        default:
+          response = FlashResponse.completedWithPoller(poller!)
+        }
+        
+        resignActive(response)
+      }
+    }
+  }
+  
+  /**
+  Swift specific method for performing a BlinkUp while timestamping frames
+
+  The SDK does not report when the flash itself begins, so frames during the
+  presentation animation and the preFlashCountdownTime countdown are left
+  out of the report by time. The SDK flash cannot be interrupted; use
+  the monitor's toleranceExceeded closure or the returned report to decide
+  whether to flash again rather than waiting for the poller to time out.
+
+  :param: networkConfig The WifiConfig, WpsConfig, or ClearConfig that is to
+    be performed.
+  :param: configId      The single use configId for this flashing session
+  :param: animated      Should the presentation be animated
+  :param: frameMonitor  Monitor that timestamps frames during the flash
+  :param: queue         Queue the closure is called on
+  :param: resignActive  Closure that is executed when the BlinkUp screen is
+    dismissed, with the frame timing observed during the flash
+  */
+  public func presentFlashWithNetworkConfig (_ networkConfig: BUNetworkConfig, configId:BUConfigId?, animated:Bool, frameMonitor: BUFlashFrameMonitor, queue: DispatchQueue = DispatchQueue.main, resignActive :@escaping (_ flashResponse: FlashResponse, _ frameReport: BUFlashFrameReport) -> () )
+  {
+    let presentationDuration: CFTimeInterval = animated ? 0.5 : 0
+    frameMonitor.start(ignoringFirst: presentationDuration + CFTimeInterval(self.preFlashCountdownTime))
+    self.presentFlashWithNetworkConfig(networkConfig, configId: configId, animated: animated, queue: DispatchQueue.main) { (response) -> () in
+      let report = frameMonitor.stop()
+      queue.blinkUpAsync {
+        resignActive(response, report)
+      }
+    }
+  }
+  
+  /**
+  Load the interstitial image in the background at the size it is displayed
+
+  The image file is decoded off the main thread and downsampled so that its
+  longest side covers maxPointSize points at the screen scale, instead of
+  being decoded at full size when the flash interface is presented.
+
+  :param: url          Location of the image file
+  :param: maxPointSize Longest side of the displayed image in points. The
+    default matches the suggested 560x760 \@2x interstitial, 280x380 points
+  :param: completion   Closure called on the main queue once interstitialImage
+    is set. It receives false if the image could not be decoded
+  */
+  public func loadInterstitialImage(contentsOf url: URL, maxPointSize: CGFloat = 380, completion: ((_ loaded: Bool) -> ())? = nil)
+  {
+    let scale = UIScreen.main.scale
+    let maxPixelSize = Int((maxPointSize * scale).rounded(.up))
+    DispatchQueue.global(qos: .userInitiated).async {
+      var image: UIImage?
+      let sourceOptions = [kCGImageSourceShouldCache: false] as CFDictionary
+      if let source = CGImageSourceCreateWithURL(url as CFURL, sourceOptions) {
+        let thumbnailOptions = [
+          kCGImageSourceCreateThumbnailFromImageAlways: true,
+          kCGImageSourceCreateThumbnailWithTransform: true,
+          kCGImageSourceShouldCacheImmediately: true,
+          kCGImageSourceThumbnailMaxPixelSize: maxPixelSize
+        ] as CFDictionary
+        if let cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0, thumbnailOptions) {
+          image = UIImage(cgImage: cgImage, scale: scale, orientation: .up)
+        }
+      }
+
+      DispatchQueue.main.async {
+        if let image = image {
+          self.interstitialImage = image
+        }
+        completion?(image != nil)
       }
-      
-      resignActive(response)
     }
   }
 }
@@ -0,0 +1,232 @@
+//
+//  BUFlashFrameMonitor.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import QuartzCore
+import UIKit
+
+/**
+Source of display frame timestamps
+
+The monitor receives one callback per presented frame, with the seconds the
+display allotted to that frame. CADisplayLink is used on device;
+BUVirtualDisplayClock replays recorded or synthetic timestamps so the monitor
+can be exercised without a screen.
+*/
+public protocol BUDisplayClock: AnyObject {
+  /// Nominal seconds between frames
+  var frameDuration: CFTimeInterval { get }
+
+  /// Start calling the handler with the timestamp and duration of each presented frame
+  func start(_ frameHandler: @escaping (_ timestamp: CFTimeInterval, _ duration: CFTimeInterval) -> ())
+
+  /// Stop calling the frame handler
+  func stop()
+}
+
+/**
+Display clock driven by CADisplayLink on the main run loop
+
+The link is pinned to framesPerSecond, so on ProMotion displays it does not
+tick at the panel's maximum rate. Each frame reports the duration the display
+actually allotted to it.
+*/
+public final class BUDisplayLinkClock: NSObject, BUDisplayClock {
+  private var displayLink: CADisplayLink?
+  private var frameHandler: ((_ timestamp: CFTimeInterval, _ duration: CFTimeInterval) -> ())?
+
+  /// Rate the display link is requested to run at
+  public let framesPerSecond: Int
+
+  /**
+  :param: framesPerSecond Rate the display link is requested to run at
+  */
+  public init(framesPerSecond: Int = 60) {
+    self.framesPerSecond = max(1, min(framesPerSecond, UIScreen.main.maximumFramesPerSecond))
+  }
+
+  public var frameDuration: CFTimeInterval {
+    return 1.0 / Double(framesPerSecond)
+  }
+
+  public func start(_ frameHandler: @escaping (_ timestamp: CFTimeInterval, _ duration: CFTimeInterval) -> ()) {
+    stop()
+    self.frameHandler = frameHandler
+    let link = CADisplayLink(target: self, selector: #selector(frameDidPresent(_:)))
+    link.preferredFramesPerSecond = framesPerSecond
+    link.add(to: RunLoop.main, forMode: RunLoop.Mode.common)
+    displayLink = link
+  }
+
+  public func stop() {
+    displayLink?.invalidate()
+    displayLink = nil
+    frameHandler = nil
+  }
+
+  @objc private func frameDidPresent(_ link: CADisplayLink) {
+    let duration = link.targetTimestamp - link.timestamp
+    frameHandler?(link.timestamp, duration > 0 ? duration : frameDuration)
+  }
+}
+
+/**
+Display clock that replays a list of frame timestamps synchronously
+*/
+public final class BUVirtualDisplayClock: BUDisplayClock {
+  public let frameDuration: CFTimeInterval
+  private let timestamps: [CFTimeInterval]
+  private var isRunning = false
+
+  /**
+  :param: frameDuration Nominal seconds between frames
+  :param: timestamps    Timestamps delivered, in order, when the clock starts
+  */
+  public init(frameDuration: CFTimeInterval, timestamps: [CFTimeInterval]) {
+    self.frameDuration = frameDuration
+    self.timestamps = timestamps
+  }
+
+  public func start(_ frameHandler: @escaping (_ timestamp: CFTimeInterval, _ duration: CFTimeInterval) -> ()) {
+    isRunning = true
+    for timestamp in timestamps where isRunning {
+      frameHandler(timestamp, frameDuration)
+    }
+  }
+
+  public func stop() {
+    isRunning = false
+  }
+}
+
+/**
+Summary of frame timing observed during a flash
+*/
+public struct BUFlashFrameReport {
+  /// Frames presented while monitoring
+  public var framesPresented = 0
+  /// Frame slots that passed without a frame being presented
+  public var framesDropped = 0
+  /// Largest difference in seconds between a frame and its intended slot
+  public var maximumJitter: CFTimeInterval = 0
+  /// Timestamp of the first frame that exceeded the tolerance, if any
+  public var firstViolation: CFTimeInterval?
+
+  /// True if any frame exceeded the tolerance
+  public var exceededTolerance: Bool {
+    return firstViolation != nil
+  }
+}
+
+/**
+Timestamps presented frames during a flash and detects dropped or late frames
+
+The SDK drives the flash itself and gives no timing feedback. The monitor
+watches the same display refresh and compares every presented frame against
+its intended slot. When a frame is dropped or its jitter exceeds the
+tolerance, `toleranceExceeded` is called once so the flash can be repeated
+without waiting for the poller to time out.
+*/
+public final class BUFlashFrameMonitor {
+
+  /// Clock the frames are timestamped with
+  public let clock: BUDisplayClock
+
+  /// Largest jitter in seconds tolerated before the flash is considered corrupt
+  public let jitterTolerance: CFTimeInterval
+
+  /// Number of consecutive dropped frames tolerated
+  public let droppedFrameTolerance: Int
+
+  /// Closure called once when the tolerance is first exceeded
+  public var toleranceExceeded: ((_ report: BUFlashFrameReport) -> ())?
+
+  private var report = BUFlashFrameReport()
+  private var ignoredDuration: CFTimeInterval = 0
+  private var ignoreUntil: CFTimeInterval?
+  private var lastTimestamp: CFTimeInterval?
+  private var lastDuration: CFTimeInterval = 0
+
+  /**
+  :param: clock                 Clock the frames are timestamped with
+  :param: jitterTolerance       Largest jitter tolerated, by default a quarter frame
+  :param: droppedFrameTolerance Consecutive dropped frames tolerated
+  */
+  public init(clock: BUDisplayClock = BUDisplayLinkClock(), jitterTolerance: CFTimeInterval? = nil, droppedFrameTolerance: Int = 0) {
+    self.clock = clock
+    self.jitterTolerance = jitterTolerance ?? clock.frameDuration / 4
+    self.droppedFrameTolerance = droppedFrameTolerance
+  }
+
+  /**
+  Start timestamping frames. Any previous report is discarded.
+
+  :param: delay Seconds after the first frame during which frames are not
+    judged, such as the countdown shown before the flash
+  */
+  public func start(ignoringFirst delay: CFTimeInterval = 0) {
+    report = BUFlashFrameReport()
+    ignoredDuration = max(0, delay)
+    ignoreUntil = nil
+    lastTimestamp = nil
+    lastDuration = 0
+    clock.start { [weak self] (timestamp, duration) -> () in
+      self?.framePresented(at: timestamp, duration: duration)
+    }
+  }
+
+  /**
+  Stop timestamping frames
+
+  :returns: The frames observed since start
+  */
+  @discardableResult
+  public func stop() -> BUFlashFrameReport {
+    clock.stop()
+    return report
+  }
+
+  // Each frame is judged against the previous one using the duration the
+  // display allotted to that previous frame, so a change of refresh rate is
+  // not counted as drops
+  private func framePresented(at timestamp: CFTimeInterval, duration: CFTimeInterval) {
+    guard let ignoreUntil = ignoreUntil else {
+      self.ignoreUntil = timestamp + ignoredDuration
+      if ignoredDuration == 0 {
+        lastTimestamp = timestamp
+        lastDuration = duration
+        report.framesPresented = 1
+      }
+      return
+    }
+    guard timestamp >= ignoreUntil else {
+      return
+    }
+    guard let last = lastTimestamp, lastDuration > 0 else {
+      lastTimestamp = timestamp
+      lastDuration = duration
+      report.framesPresented += 1
+      return
+    }
+
+    let elapsed = (timestamp - last) / lastDuration
+    let slots = max(1, Int(elapsed.rounded()))
+    let jitter = abs(elapsed - Double(slots)) * lastDuration
+    let dropped = slots - 1
+
+    report.framesPresented += 1
+    report.framesDropped += dropped
+    report.maximumJitter = max(report.maximumJitter, jitter)
+    lastTimestamp = timestamp
+    lastDuration = duration
+
+    if report.firstViolation == nil && (jitter > jitterTolerance || dropped > droppedFrameTolerance) {
+      report.firstViolation = timestamp
+      toleranceExceeded?(report)
+    }
+  }
+}
@@ -0,0 +1,354 @@
+//
+//  BUHostHealth.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Per-host circuit breaker and shared retry budget for impCloud requests
+
+Requests made through the hostHealth variants of the Swift extension methods
+consult the tracker before going to the server. After `failureThreshold`
+consecutive server or network failures the circuit for the host opens and
+requests fail immediately. Once `openDuration` has passed a single request is
+let through (half-open); its result closes or re-opens the circuit.
+
+Retries draw from a budget shared by every session, which is refilled by
+successful requests and slowly over time, so an outage does not turn into a
+synchronized retry storm. Retry delays use capped exponential backoff with
+full jitter.
+*/
+public final class BUHostHealth {
+
+  /**
+  Swift enumeration of circuit states
+
+  - Closed:   Requests are sent normally
+  - Open:     Requests fail immediately until the given date
+  - HalfOpen: A single probe request is allowed to test the host
+  */
+  public enum State: Equatable {
+    case closed
+    case open(until: Date)
+    case halfOpen
+  }
+
+  /**
+  Domain of the errors raised by the tracker itself
+  */
+  public static let errorDomain = "com.electricimp.blinkup.hosthealth"
+
+  /**
+  Swift enumeration of the error codes in `errorDomain`
+
+  - CircuitOpen: The request was not sent because the circuit for the host is open
+  */
+  public enum ErrorCode: Int {
+    case circuitOpen = 1
+  }
+
+  /**
+  Tracker shared by all sessions that do not supply their own
+  */
+  public static let shared = BUHostHealth()
+
+  /// Consecutive failures that open the circuit
+  public let failureThreshold: Int
+  /// Seconds the circuit stays open before a probe is allowed
+  public let openDuration: TimeInterval
+  /// Largest number of retries that can be saved up in the budget
+  public let retryBudgetCapacity: Double
+  /// Retries added to the budget by each successful request
+  public let retryBudgetPerSuccess: Double
+  /// Retries added to the budget every second
+  public let retryBudgetPerSecond: Double
+  /// Delay before the first retry in seconds
+  public let baseRetryDelay: TimeInterval
+  /// Largest delay between retries in seconds
+  public let maximumRetryDelay: TimeInterval
+  /// Most retries attempted for a single request
+  public let maximumRetries: Int
+  /// Seconds after which a probe that never reported back is abandoned
+  public let probeTimeout: TimeInterval
+
+  private struct Host {
+    var state = State.closed
+    var consecutiveFailures = 0
+    var probeStart: Date?
+  }
+
+  private let lock = NSLock()
+  private var hosts = [String: Host]()
+  private var budget: Double
+  private var budgetDate = Date()
+
+  public init(failureThreshold: Int = 5, openDuration: TimeInterval = 30, retryBudgetCapacity: Double = 10, retryBudgetPerSuccess: Double = 0.1, retryBudgetPerSecond: Double = 0.5, baseRetryDelay: TimeInterval = 0.5, maximumRetryDelay: TimeInterval = 30, maximumRetries: Int = 3, probeTimeout: TimeInterval = 120) {
+    self.failureThreshold = max(1, failureThreshold)
+    self.openDuration = openDuration
+    self.retryBudgetCapacity = retryBudgetCapacity
+    self.retryBudgetPerSuccess = retryBudgetPerSuccess
+    self.retryBudgetPerSecond = retryBudgetPerSecond
+    self.baseRetryDelay = baseRetryDelay
+    self.maximumRetryDelay = maximumRetryDelay
+    self.maximumRetries = maximumRetries
+    self.probeTimeout = probeTimeout
+    self.budget = retryBudgetCapacity
+  }
+
+  /**
+  Host the SDK currently sends requests to
+  */
+  public static var currentHost: String {
+    return BUSDK.privateCloudHost() ?? "api.electricimp.com"
+  }
+
+  /**
+  Circuit state of a host
+  */
+  public func state(forHost host: String = BUHostHealth.currentHost) -> State {
+    lock.lock()
+    defer { lock.unlock() }
+    return hosts[host]?.state ?? State.closed
+  }
+
+  /**
+  Retries currently available in the shared budget
+  */
+  public var availableRetries: Double {
+    lock.lock()
+    defer { lock.unlock() }
+    refillBudget()
+    return budget
+  }
+
+  /**
+  Check if an error counts against the health of the host
+  */
+  public static func isHostFailure(_ error: NSError) -> Bool {
+    guard error.domain == BlinkUpErrorDomain else {
+      return false
+    }
+    return error.code == BlinkUpError.serverResponseFailed.rawValue || error.code == BlinkUpError.networkError.rawValue
+  }
+
+  /**
+  Swift Internal admission check. Returns false while the circuit is open or
+  while the half-open probe is in flight. A probe that has not reported back
+  within `probeTimeout` no longer blocks the next one.
+  */
+  internal func shouldSend(toHost host: String) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    var entry = hosts[host] ?? Host()
+    defer { hosts[host] = entry }
+    switch entry.state {
+    case .closed:
+      return true
+    case .open(let until):
+      guard until <= Date() else {
+        return false
+      }
+      entry.state = State.halfOpen
+      entry.probeStart = Date()
+      return true
+    case .halfOpen:
+      if let probeStart = entry.probeStart, probeStart.timeIntervalSinceNow > -probeTimeout {
+        return false
+      }
+      entry.probeStart = Date()
+      return true
+    }
+  }
+
+  /**
+  Swift Internal record of a request that reached the host
+  */
+  internal func recordSuccess(forHost host: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    hosts[host] = Host()
+    refillBudget()
+    budget = min(retryBudgetCapacity, budget + retryBudgetPerSuccess)
+  }
+
+  /**
+  Swift Internal record of a server or network failure
+  */
+  internal func recordFailure(forHost host: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    var entry = hosts[host] ?? Host()
+    entry.consecutiveFailures += 1
+    entry.probeStart = nil
+    if entry.state == State.halfOpen || entry.consecutiveFailures >= failureThreshold {
+      entry.state = State.open(until: Date(timeIntervalSinceNow: openDuration))
+    }
+    hosts[host] = entry
+  }
+
+  /**
+  Swift Internal release of a request that was stopped before it completed.
+  If it was the half-open probe, the next request may probe instead.
+  */
+  internal func recordCancellation(forHost host: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    if hosts[host]?.state == State.halfOpen {
+      hosts[host]?.probeStart = nil
+    }
+  }
+
+  /**
+  Swift Internal retry decision. Returns the delay before the retry, or nil
+  if the request must not be retried.
+  */
+  internal func retryDelay(forHost host: String, attempt: Int) -> TimeInterval? {
+    lock.lock()
+    defer { lock.unlock() }
+    refillBudget()
+    guard attempt < maximumRetries, budget >= 1 else {
+      return nil
+    }
+    if case .open(_)? = hosts[host]?.state {
+      return nil
+    }
+    budget -= 1
+    let ceiling = min(maximumRetryDelay, baseRetryDelay * pow(2, Double(attempt)))
+    return Double.random(in: 0...ceiling)
+  }
+
+  /**
+  Swift Internal error returned while the circuit is open
+  */
+  internal static func circuitOpenError(forHost host: String) -> NSError {
+    return NSError(domain: BUHostHealth.errorDomain, code: ErrorCode.circuitOpen.rawValue, userInfo: [NSLocalizedDescriptionKey: "Requests to \(host) are paused after repeated failures"])
+  }
+
+  private func refillBudget() {
+    let now = Date()
+    budget = min(retryBudgetCapacity, budget + now.timeIntervalSince(budgetDate) * retryBudgetPerSecond)
+    budgetDate = now
+  }
+}
+
+extension BUConfigId {
+
+  /**
+  Swift specific ConfigId retrieval that respects host health
+
+  Fails immediately while the circuit for the host is open. Server and network
+  errors are retried with backoff while the shared retry budget allows.
+
+  :param: apiKey     The APIKey assigned to you from Electric Imp
+  :param: planId     An existing planId, or nil to have one generated
+  :param: hostHealth Tracker for the impCloud host
+  :param: queue      Queue the handler is called on
+  :param: handler    Closure called when the configuration id is
+    retrieved from the Electric Imp server.
+  */
+  public class func retrieve(apiKey: String, planId: String? = nil, hostHealth: BUHostHealth, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    retrieve(apiKey: apiKey, planId: planId, hostHealth: hostHealth, attempt: 0, queue: queue, handler: handler)
+  }
+
+  private class func retrieve(apiKey: String, planId: String?, hostHealth: BUHostHealth, attempt: Int, queue: DispatchQueue, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    let host = BUHostHealth.currentHost
+    guard hostHealth.shouldSend(toHost: host) else {
+      queue.async {
+        handler(ConfigIdResponse.error(BUHostHealth.circuitOpenError(forHost: host)))
+      }
+      return
+    }
+
+    let completion = { (response: ConfigIdResponse) -> () in
+      guard case .error(let error) = response, BUHostHealth.isHostFailure(error) else {
+        hostHealth.recordSuccess(forHost: host)
+        handler(response)
+        return
+      }
+      hostHealth.recordFailure(forHost: host)
+      guard let delay = hostHealth.retryDelay(forHost: host, attempt: attempt) else {
+        handler(response)
+        return
+      }
+      DispatchQueue.main.asyncAfter(deadline: .now() + delay) {
+        BUConfigId.retrieve(apiKey: apiKey, planId: planId, hostHealth: hostHealth, attempt: attempt + 1, queue: queue, handler: handler)
+      }
+    }
+    if let planId = planId {
+      _ = BUConfigId(apiKey: apiKey, planId: planId, queue: queue, handler: completion)
+    } else {
+      _ = BUConfigId(apiKey: apiKey, queue: queue, handler: completion)
+    }
+  }
+}
+
+extension BUDevicePoller {
+
+  /**
+  Swift Internal polling that respects host health, used by
+  `startPollingWithHandler(options:)`
+
+  Fails immediately while the circuit for the host is open. Server and network
+  errors are retried with backoff, using a new poller for the same configId,
+  while the shared retry budget allows. Retries share the `pollTimeout` of
+  the first poller: each one polls only for the time left, and the last error
+  is reported once none is left. Cancelling the token stops whichever poller
+  is running and suppresses the handler.
+  */
+  internal func startPollingWithHandler(hostHealth: BUHostHealth, cancellationToken: BUCancellationToken, attempt: Int, deadline: Date? = nil, queue: DispatchQueue, _ responseHandler: @escaping (_ response:PollerResponse) -> ()) {
+    guard !cancellationToken.isCancelled else {
+      return
+    }
+    let deadline = deadline ?? Date(timeIntervalSinceNow: self.pollTimeout)
+    let host = BUHostHealth.currentHost
+    guard hostHealth.shouldSend(toHost: host) else {
+      queue.async {
+        responseHandler(PollerResponse.error(BUHostHealth.circuitOpenError(forHost: host)))
+      }
+      return
+    }
+
+    let handlerId = cancellationToken.register {
+      self.stopPolling()
+      hostHealth.recordCancellation(forHost: host)
+    }
+    guard !cancellationToken.isCancelled else {
+      return
+    }
+    let configId = self.configId
+    self.startPollingWithHandler(queue: queue) { (response) -> () in
+      cancellationToken.unregister(handlerId)
+      guard !cancellationToken.isCancelled else {
+        return
+      }
+      guard case .error(let error) = response, BUHostHealth.isHostFailure(error) else {
+        hostHealth.recordSuccess(forHost: host)
+        responseHandler(response)
+        return
+      }
+      hostHealth.recordFailure(forHost: host)
+      guard deadline.timeIntervalSinceNow > 0, let delay = hostHealth.retryDelay(forHost: host, attempt: attempt), delay < deadline.timeIntervalSinceNow else {
+        responseHandler(response)
+        return
+      }
+      DispatchQueue.main.asyncAfter(deadline: .now() + delay) {
+        let remaining = deadline.timeIntervalSinceNow
+        guard remaining > 0 else {
+          if !cancellationToken.isCancelled {
+            queue.blinkUpAsync {
+              responseHandler(response)
+            }
+          }
+          return
+        }
+        let poller = BUDevicePoller(configId: configId)
+        poller.pollTimeout = remaining
+        poller.startPollingWithHandler(hostHealth: hostHealth, cancellationToken: cancellationToken, attempt: attempt + 1, deadline: deadline, queue: queue, responseHandler)
+      }
+    }
+  }
+}
@@ -0,0 +1,298 @@
+//
+//  BULoadGenerator.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import Darwin
+import BlinkUp
+
+/**
+Drive many simulated provisioning sessions against a backend
+
+Each session requests a setup token and then polls for the device, as a
+station does after a flash. Sessions start at the configured arrival rate and
+the generator reports latency percentiles, process resource usage and errors
+grouped by domain and code. Open sockets and resident memory are sampled on
+a timer off the session queue so the sampling does not add to the measured
+latencies. CPU, memory and sockets are measured for the whole process, so
+only one run can be in progress at a time.
+*/
+public final class BULoadGenerator {
+
+  /**
+  Load profile for a run
+  */
+  public struct Configuration {
+    /// Number of sessions to run
+    public var sessions: Int
+    /// Sessions started per second
+    public var arrivalRate: Double
+    /// Space arrivals as a Poisson process instead of evenly
+    public var poissonArrivals: Bool
+    /// API key passed to the backend
+    public var apiKey: String
+    /// Existing planId, or nil to have a plan generated per session
+    public var planId: String?
+    /// pollTimeout of each session
+    public var pollTimeout: TimeInterval
+    /// Seconds between samples of the open socket count and resident memory
+    public var socketSampleInterval: TimeInterval
+
+    public init(sessions: Int, arrivalRate: Double, poissonArrivals: Bool = true, apiKey: String, planId: String? = nil, pollTimeout: TimeInterval = 60, socketSampleInterval: TimeInterval = 0.5) {
+      self.sessions = sessions
+      self.arrivalRate = arrivalRate
+      self.poissonArrivals = poissonArrivals
+      self.apiKey = apiKey
+      self.planId = planId
+      self.pollTimeout = pollTimeout
+      self.socketSampleInterval = socketSampleInterval
+    }
+  }
+
+  /**
+  Error domain and code a failed session is counted under, so BlinkUpError
+  codes are not mixed with NSURLError or other codes
+  */
+  public struct ErrorKey: Hashable {
+    public let domain: String
+    public let code: Int
+  }
+
+  /**
+  Latency percentiles in seconds
+  */
+  public struct Percentiles {
+    public let count: Int
+    public let p50: TimeInterval
+    public let p95: TimeInterval
+    public let p99: TimeInterval
+
+    init(_ samples: [TimeInterval]) {
+      let sorted = samples.sorted()
+      count = sorted.count
+      func percentile(_ fraction: Double) -> TimeInterval {
+        guard !sorted.isEmpty else {
+          return 0
+        }
+        let index = Int((fraction * Double(sorted.count - 1)).rounded())
+        return sorted[index]
+      }
+      p50 = percentile(0.50)
+      p95 = percentile(0.95)
+      p99 = percentile(0.99)
+    }
+  }
+
+  /**
+  Results of a run
+  */
+  public struct Report {
+    /// Setup token latency of successful token requests
+    public let token: Percentiles
+    /// Poll latency of polls that found the device
+    public let poll: Percentiles
+    /// Token plus poll latency of sessions that found the device
+    public let endToEnd: Percentiles
+    /// Sessions whose device connected
+    public let connected: Int
+    /// Sessions whose poll timed out
+    public let timedOut: Int
+    /// Failed sessions by error domain and code
+    public let errors: [ErrorKey: Int]
+    /// Wall clock duration of the run
+    public let duration: TimeInterval
+    /// User plus system CPU seconds used by the process during the run
+    public let cpuTime: TimeInterval
+    /// Resident memory of the process at the end of the run, in bytes
+    public let residentBytes: UInt64
+    /// Largest resident memory of the process sampled during the run, in bytes
+    public let peakResidentBytes: UInt64
+    /// Largest number of open sockets sampled during the run
+    public let peakSockets: Int
+  }
+
+  private let backend: BUProvisioningBackend
+  private let queue = DispatchQueue(label: "com.electricimp.blinkup.loadgenerator")
+  private var random = SplitMix64(seed: 1)
+  private var tokenLatencies = [TimeInterval]()
+  private var pollLatencies = [TimeInterval]()
+  private var endToEndLatencies = [TimeInterval]()
+  private var connected = 0
+  private var timedOut = 0
+  private var errors = [ErrorKey: Int]()
+  private var finished = 0
+  private var peakSockets = 0
+  private var peakResidentBytes: UInt64 = 0
+  private var sampler: DispatchSourceTimer?
+  private let runLock = NSLock()
+  private var isRunning = false
+
+  /**
+  :param: backend Backend the sessions run against, such as BUSDKBackend or BUSimulatedCloud
+  */
+  public init(backend: BUProvisioningBackend) {
+    self.backend = backend
+  }
+
+  /**
+  Run the configured number of sessions
+
+  :param: configuration Load profile for the run
+  :param: completion    Closure called on an internal queue once every session has finished
+
+  :returns: False if a run is already in progress, in which case nothing is started
+  */
+  @discardableResult
+  public func run(_ configuration: Configuration, completion: @escaping (_ report: Report) -> ()) -> Bool {
+    runLock.lock()
+    guard !isRunning else {
+      runLock.unlock()
+      return false
+    }
+    isRunning = true
+    runLock.unlock()
+
+    queue.async {
+      self.reset()
+      let start = Date()
+      let startCPU = BULoadGenerator.cpuTime()
+      self.startSampling(every: configuration.socketSampleInterval)
+      let finish = {
+        self.sampler?.cancel()
+        self.sampler = nil
+        self.peakSockets = max(self.peakSockets, BULoadGenerator.openSockets())
+        let residentBytes = BULoadGenerator.residentBytes()
+        self.peakResidentBytes = max(self.peakResidentBytes, residentBytes)
+        let report = Report(token: Percentiles(self.tokenLatencies),
+                            poll: Percentiles(self.pollLatencies),
+                            endToEnd: Percentiles(self.endToEndLatencies),
+                            connected: self.connected,
+                            timedOut: self.timedOut,
+                            errors: self.errors,
+                            duration: Date().timeIntervalSince(start),
+                            cpuTime: BULoadGenerator.cpuTime() - startCPU,
+                            residentBytes: residentBytes,
+                            peakResidentBytes: self.peakResidentBytes,
+                            peakSockets: self.peakSockets)
+        self.runLock.lock()
+        self.isRunning = false
+        self.runLock.unlock()
+        completion(report)
+      }
+      guard configuration.sessions > 0 else {
+        finish()
+        return
+      }
+
+      var offset: TimeInterval = 0
+      for _ in 0..<configuration.sessions {
+        self.queue.asyncAfter(deadline: .now() + offset) {
+          self.startSession(configuration) {
+            self.finished += 1
+            if self.finished == configuration.sessions {
+              finish()
+            }
+          }
+        }
+        let gap = 1 / max(configuration.arrivalRate, .ulpOfOne)
+        offset += configuration.poissonArrivals ? -gap * log(1 - self.random.nextUnit()) : gap
+      }
+    }
+    return true
+  }
+
+  private func reset() {
+    tokenLatencies.removeAll()
+    pollLatencies.removeAll()
+    endToEndLatencies.removeAll()
+    connected = 0
+    timedOut = 0
+    errors.removeAll()
+    finished = 0
+    peakSockets = 0
+    peakResidentBytes = 0
+  }
+
+  private func startSampling(every interval: TimeInterval) {
+    let timer = DispatchSource.makeTimerSource(queue: DispatchQueue.global(qos: .utility))
+    timer.schedule(deadline: .now(), repeating: max(interval, 0.01))
+    timer.setEventHandler { [weak self] in
+      let sockets = BULoadGenerator.openSockets()
+      let residentBytes = BULoadGenerator.residentBytes()
+      self?.queue.async {
+        guard let strongSelf = self else {
+          return
+        }
+        strongSelf.peakSockets = max(strongSelf.peakSockets, sockets)
+        strongSelf.peakResidentBytes = max(strongSelf.peakResidentBytes, residentBytes)
+      }
+    }
+    timer.resume()
+    sampler = timer
+  }
+
+  private func startSession(_ configuration: Configuration, done: @escaping () -> ()) {
+    let sessionStart = Date()
+    backend.requestToken(apiKey: configuration.apiKey, planId: configuration.planId) { (result) -> () in
+      self.queue.async {
+        switch result {
+        case .failure(let error):
+          self.errors[ErrorKey(domain: error.domain, code: error.code), default: 0] += 1
+          done()
+        case .success(let token):
+          let pollStart = Date()
+          self.tokenLatencies.append(pollStart.timeIntervalSince(sessionStart))
+          self.backend.poll(token: token, timeout: configuration.pollTimeout) { (response) -> () in
+            self.queue.async {
+              switch response {
+              case .responded(_):
+                let end = Date()
+                self.connected += 1
+                self.pollLatencies.append(end.timeIntervalSince(pollStart))
+                self.endToEndLatencies.append(end.timeIntervalSince(sessionStart))
+              case .timedOut:
+                self.timedOut += 1
+              case .error(let error):
+                self.errors[ErrorKey(domain: error.domain, code: error.code), default: 0] += 1
+              }
+              done()
+            }
+          }
+        }
+      }
+    }
+  }
+
+  private static func cpuTime() -> TimeInterval {
+    var usage = rusage()
+    getrusage(RUSAGE_SELF, &usage)
+    let user = TimeInterval(usage.ru_utime.tv_sec) + TimeInterval(usage.ru_utime.tv_usec) / 1_000_000
+    let system = TimeInterval(usage.ru_stime.tv_sec) + TimeInterval(usage.ru_stime.tv_usec) / 1_000_000
+    return user + system
+  }
+
+  private static func residentBytes() -> UInt64 {
+    var info = mach_task_basic_info()
+    var count = mach_msg_type_number_t(MemoryLayout<mach_task_basic_info>.size / MemoryLayout<natural_t>.size)
+    let result = withUnsafeMutablePointer(to: &info) { (pointer) -> kern_return_t in
+      pointer.withMemoryRebound(to: integer_t.self, capacity: Int(count)) {
+        task_info(mach_task_self_, task_flavor_t(MACH_TASK_BASIC_INFO), $0, &count)
+      }
+    }
+    return result == KERN_SUCCESS ? UInt64(info.resident_size) : 0
+  }
+
+  private static func openSockets() -> Int {
+    var sockets = 0
+    var status = stat()
+    for descriptor in 0..<getdtablesize() where fstat(descriptor, &status) == 0 {
+      if (status.st_mode & S_IFMT) == S_IFSOCK {
+        sockets += 1
+      }
+    }
+    return sockets
+  }
+}
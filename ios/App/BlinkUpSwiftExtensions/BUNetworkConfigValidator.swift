@@ -0,0 +1,287 @@
+//
+//  BUNetworkConfigValidator.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Network features the target imp and its impOS version support
+
+The SDK cannot query the device before flashing, so the caller declares what
+the target supports and configurations that need anything else are rejected.
+*/
+public struct BUDeviceCapabilities: OptionSet {
+  public let rawValue: Int
+
+  public init(rawValue: Int) {
+    self.rawValue = rawValue
+  }
+
+  /// Wi-Fi Protected Setup (not supported by imp005 and newer)
+  public static let wps = BUDeviceCapabilities(rawValue: 1 << 0)
+  /// Ethernet (imp005 and similar)
+  public static let ethernet = BUDeviceCapabilities(rawValue: 1 << 1)
+  /// Static addressing instead of DHCP
+  public static let staticAddressing = BUDeviceCapabilities(rawValue: 1 << 2)
+  /// Network proxy
+  public static let proxy = BUDeviceCapabilities(rawValue: 1 << 3)
+
+  /// Every feature
+  public static let all: BUDeviceCapabilities = [.wps, .ethernet, .staticAddressing, .proxy]
+}
+
+/**
+Swift enumeration of problems found in a network configuration before flashing
+*/
+public enum BUConfigValidationError: Error, Equatable {
+  case ssidMissing
+  case ssidTooLong(bytes: Int)
+  case passwordInvalid
+  case wpsPinInvalid
+  case addressInvalid(field: String, value: String)
+  case netmaskNotContiguous(String)
+  case addressNotUsable(String)
+  case gatewayOutsideSubnet(String)
+  case gatewayEqualsAddress(String)
+  case proxyServerInvalid(String)
+  case proxyPortInvalid
+  case unsupportedFeature(BUDeviceCapabilities)
+  case proxyUnreachable(String)
+  case dnsServerUnreachable(String)
+}
+
+/**
+Pre-flight checks for a BUNetworkConfig
+
+Structural checks run synchronously and take microseconds. Reachability
+checks for the proxy and DNS servers need the network and are run separately
+with a timeout, from the phone's current network rather than the one being
+configured.
+*/
+public final class BUNetworkConfigValidator {
+
+  /**
+  Run all structural checks
+
+  :param: networkConfig Configuration that is about to be flashed
+  :param: capabilities  Features the target device supports
+
+  :returns: Every problem found, or an empty array if the configuration is valid
+  */
+  public class func validate(_ networkConfig: BUNetworkConfig, capabilities: BUDeviceCapabilities = BUDeviceCapabilities.all) -> [BUConfigValidationError] {
+    guard !networkConfig.isClearConfig else {
+      return []
+    }
+
+    var errors = [BUConfigValidationError]()
+    if let wifiConfig = networkConfig as? BUWifiConfig {
+      errors += validateWifi(wifiConfig)
+    } else if let wpsConfig = networkConfig as? BUWPSConfig {
+      if !capabilities.contains(.wps) {
+        errors.append(.unsupportedFeature(.wps))
+      }
+      if !isValidWPSPin(wpsConfig.pin ?? "") {
+        errors.append(.wpsPinInvalid)
+      }
+    } else if networkConfig is BUEthernetConfig && !capabilities.contains(.ethernet) {
+      errors.append(.unsupportedFeature(.ethernet))
+    }
+
+    if let addressing = networkConfig.addressing as? BUStaticAddressing {
+      if !capabilities.contains(.staticAddressing) {
+        errors.append(.unsupportedFeature(.staticAddressing))
+      }
+      errors += validateStaticAddressing(addressing)
+    }
+
+    if let proxy = networkConfig.proxy {
+      if !capabilities.contains(.proxy) {
+        errors.append(.unsupportedFeature(.proxy))
+      }
+      if proxy.server.trimmingCharacters(in: .whitespaces).isEmpty || proxy.server.contains(" ") {
+        errors.append(.proxyServerInvalid(proxy.server))
+      }
+      if proxy.port == 0 {
+        errors.append(.proxyPortInvalid)
+      }
+    }
+    return errors
+  }
+
+  /**
+  Check that the proxy accepts TCP connections and the DNS servers answer
+  queries over UDP
+
+  The probes are sent from the network the phone is on now, not from the
+  network being flashed to the device, so they only show what the phone can
+  reach. A server on a private address of the target network reports as
+  unreachable when the phone is elsewhere, and a reachable server may still
+  be blocked for the device.
+
+  :param: networkConfig Configuration that is about to be flashed
+  :param: timeout       Seconds allowed for each connection attempt
+  :param: completion    Closure called on the main queue with the unreachable servers
+  */
+  public class func validateReachability(_ networkConfig: BUNetworkConfig, timeout: TimeInterval = 2, completion: @escaping (_ errors: [BUConfigValidationError]) -> ()) {
+    let group = DispatchGroup()
+    let lock = NSLock()
+    var errors = [BUConfigValidationError]()
+    let report = { (error: BUConfigValidationError) -> (_ latency: TimeInterval?) -> () in
+      group.enter()
+      return { (latency) -> () in
+        if latency == nil {
+          lock.lock()
+          errors.append(error)
+          lock.unlock()
+        }
+        group.leave()
+      }
+    }
+
+    if let proxy = networkConfig.proxy {
+      BUConnectionProbe.connect(host: proxy.server, port: proxy.port, timeout: timeout, completion: report(.proxyUnreachable(proxy.server)))
+    }
+    if let addressing = networkConfig.addressing as? BUStaticAddressing {
+      for dns in [addressing.dns1, addressing.dns2].compactMap({ $0 }) {
+        BUConnectionProbe.dnsQuery(server: dns, timeout: timeout, completion: report(.dnsServerUnreachable(dns)))
+      }
+    }
+    group.notify(queue: DispatchQueue.main) {
+      completion(errors)
+    }
+  }
+
+  /**
+  Check a WPS pin: empty for push button, 4 digits, or 8 digits with a valid checksum
+  */
+  public class func isValidWPSPin(_ pin: String) -> Bool {
+    guard pin.allSatisfy({ $0.isASCII && $0.isNumber }) else {
+      return false
+    }
+    switch pin.count {
+    case 0, 4:
+      return true
+    case 8:
+      let digits = pin.compactMap { $0.wholeNumberValue }
+      var sum = 0
+      for (index, digit) in digits.enumerated() {
+        sum += index % 2 == 0 ? 3 * digit : digit
+      }
+      return sum % 10 == 0
+    default:
+      return false
+    }
+  }
+
+  private class func validateWifi(_ wifiConfig: BUWifiConfig) -> [BUConfigValidationError] {
+    var errors = [BUConfigValidationError]()
+    let ssidBytes = wifiConfig.ssid?.utf8.count ?? 0
+    if ssidBytes == 0 {
+      errors.append(.ssidMissing)
+    } else if ssidBytes > 32 {
+      errors.append(.ssidTooLong(bytes: ssidBytes))
+    }
+
+    if !wifiConfig.useSavedPassword, let password = wifiConfig.password, !password.isEmpty {
+      // WPA takes an 8-63 character passphrase or a 64 digit hex key, WEP a
+      // 5 or 13 character key or a 10 or 26 digit hex key
+      let length = password.utf8.count
+      let isHex = password.allSatisfy { $0.isHexDigit }
+      let isWPAKey = (8...63).contains(length) || (length == 64 && isHex)
+      let isWEPKey = length == 5 || length == 13 || ((length == 10 || length == 26) && isHex)
+      if !isWPAKey && !isWEPKey {
+        errors.append(.passwordInvalid)
+      }
+    }
+    return errors
+  }
+
+  private class func validateStaticAddressing(_ addressing: BUStaticAddressing) -> [BUConfigValidationError] {
+    var errors = [BUConfigValidationError]()
+    var fields: [(name: String, value: String)] = [("ip", addressing.ip), ("netmask", addressing.netmask), ("gateway", addressing.gateway), ("dns1", addressing.dns1)]
+    if let dns2 = addressing.dns2 {
+      fields.append(("dns2", dns2))
+    }
+    var values = [String: UInt32]()
+    for field in fields {
+      if let value = ipv4Value(field.value) {
+        values[field.name] = value
+      } else {
+        errors.append(.addressInvalid(field: field.name, value: field.value))
+      }
+    }
+    guard let ip = values["ip"], let netmask = values["netmask"], let gateway = values["gateway"] else {
+      return errors
+    }
+
+    // A valid netmask is a run of ones followed only by zeros
+    let inverted = ~netmask
+    guard netmask != 0, inverted & (inverted &+ 1) == 0 else {
+      errors.append(.netmaskNotContiguous(addressing.netmask))
+      return errors
+    }
+
+    let network = ip & netmask
+    let broadcast = network | inverted
+    if inverted > 1 && (ip == network || ip == broadcast) {
+      errors.append(.addressNotUsable(addressing.ip))
+    }
+    if gateway & netmask != network {
+      errors.append(.gatewayOutsideSubnet(addressing.gateway))
+    } else if gateway == ip {
+      errors.append(.gatewayEqualsAddress(addressing.gateway))
+    }
+    return errors
+  }
+
+  private class func ipv4Value(_ string: String) -> UInt32? {
+    let parts = string.split(separator: ".", omittingEmptySubsequences: false)
+    guard parts.count == 4 else {
+      return nil
+    }
+    var value: UInt32 = 0
+    for part in parts {
+      guard !part.isEmpty, part.count <= 3, let octet = UInt32(part), octet <= 255 else {
+        return nil
+      }
+      value = value << 8 | octet
+    }
+    return value
+  }
+}
+
+extension BUFlashController {
+
+  /**
+  Swift specific method for performing a BlinkUp after pre-flight validation
+
+  The configuration is checked before anything is presented. If it has
+  problems the flash is not presented, resignActive is not called and the
+  problems are returned, so no flash or pollTimeout is spent on it.
+
+  :param: networkConfig The WifiConfig, WpsConfig, or ClearConfig that is to
+    be performed.
+  :param: configId      The single use configId for this flashing session. This
+    can be nil in the case of clearing a device
+  :param: animated      Should the presentation be animated
+  :param: capabilities  Features the target device supports
+  :param: queue         Queue the closure is called on
+  :param: resignActive  Closure that is executed when the BlinkUp screen is
+    dismissed and control is returned to the presenting screen
+
+  :returns: The problems found. The flash was only presented if this is empty
+  */
+  @discardableResult
+  public func presentFlashWithNetworkConfig (_ networkConfig: BUNetworkConfig, configId:BUConfigId?, animated:Bool, validatingFor capabilities: BUDeviceCapabilities, queue: DispatchQueue = DispatchQueue.main, resignActive :@escaping (_ flashResponse: FlashResponse) -> () ) -> [BUConfigValidationError]
+  {
+    let errors = BUNetworkConfigValidator.validate(networkConfig, capabilities: capabilities)
+    if errors.isEmpty {
+      self.presentFlashWithNetworkConfig(networkConfig, configId: configId, animated: animated, queue: queue, resignActive: resignActive)
+    }
+    return errors
+  }
+}
@@ -30,6 +30,7 @@ extension BUNetworkSelectController {
   :param: completionHander Executed immediatly after control is returned from the interface
   */
   public func presentInterfaceAnimated(_ animated:Bool, completionHander:@escaping (_ response:InterfaceResponse) -> ()) {    
+    BUSDK.ensureConfigured()
     self.presentInterface(animated: animated) { (networkConfig:BUNetworkConfig?, userDidCancel:Bool) -> Void in
       var response: InterfaceResponse
       switch (networkConfig, userDidCancel) {
@@ -0,0 +1,236 @@
+//
+//  BUPlanIdCache.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Persistent cache of planIds keyed by API key and user identifier
+
+Without a planId every BlinkUp asks the server for a new plan before the
+setup token. Reusing the plan saves that round trip. The cache is keyed by
+the API key and `BUHelper.userIdentifier()`, so a changed user identity never
+reuses another user's plan. Entries are dropped when the server reports
+`BlinkUpError.planIDInvalid`.
+
+Concurrent retrievals for an API key with no cached plan share a single plan
+lookup. The first one generates the plan and the others wait for it, then
+request their own setup tokens with the new planId.
+*/
+public final class BUPlanIdCache {
+
+  /**
+  Cache stored in the standard user defaults
+  */
+  public static let shared = BUPlanIdCache()
+
+  private let defaults: UserDefaults
+  private let defaultsKey: String
+  private let lock = NSLock()
+  private var planLookups = [String: [(_ error: NSError?) -> ()]]()
+  private var lookupCount = 0
+  private var coalescedCount = 0
+
+  /**
+  :param: defaults    User defaults the cache is persisted in
+  :param: defaultsKey Key of the dictionary holding all cached planIds
+  */
+  public init(defaults: UserDefaults = UserDefaults.standard, defaultsKey: String = "com.electricimp.blinkup.planIds") {
+    self.defaults = defaults
+    self.defaultsKey = defaultsKey
+  }
+
+  /**
+  Cached planId for an API key and the current user identifier, or nil
+  */
+  public func planId(forApiKey apiKey: String) -> String? {
+    lock.lock()
+    defer { lock.unlock() }
+    guard let planId = entries()[entryKey(apiKey)], !planId.isEmpty else {
+      return nil
+    }
+    return planId
+  }
+
+  /**
+  Store a planId for an API key and the current user identifier
+  */
+  public func store(_ planId: String, forApiKey apiKey: String) {
+    guard !planId.isEmpty else {
+      return
+    }
+    lock.lock()
+    defer { lock.unlock() }
+    var cached = entries()
+    cached[entryKey(apiKey)] = planId
+    defaults.set(cached, forKey: defaultsKey)
+  }
+
+  /**
+  Remove the planId for an API key and the current user identifier
+  */
+  public func invalidate(forApiKey apiKey: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    var cached = entries()
+    cached[entryKey(apiKey)] = nil
+    defaults.set(cached, forKey: defaultsKey)
+  }
+
+  /**
+  Remove every cached planId
+  */
+  public func removeAll() {
+    lock.lock()
+    defer { lock.unlock() }
+    defaults.removeObject(forKey: defaultsKey)
+  }
+
+  /**
+  Number of plan lookups sent to the server by `BUConfigId.retrieve`
+  */
+  public var planLookupCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return lookupCount
+  }
+
+  /**
+  Number of retrievals that waited for a plan lookup already in flight
+  */
+  public var coalescedPlanLookupCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return coalescedCount
+  }
+
+  /**
+  Swift Internal registration for the plan lookup of an API key. Returns true
+  if the caller must perform the lookup, false if it joined one in flight.
+  */
+  internal func joinPlanLookup(forApiKey apiKey: String, waiter: @escaping (_ error: NSError?) -> ()) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    let key = entryKey(apiKey)
+    if planLookups[key] != nil {
+      coalescedCount += 1
+      planLookups[key]!.append(waiter)
+      return false
+    }
+    lookupCount += 1
+    planLookups[key] = []
+    return true
+  }
+
+  /**
+  Swift Internal completion of a plan lookup. Waiters are called with the
+  lookup error, or nil once the new planId has been stored.
+  */
+  internal func finishPlanLookup(forApiKey apiKey: String, error: NSError?) {
+    lock.lock()
+    let waiters = planLookups.removeValue(forKey: entryKey(apiKey)) ?? []
+    lock.unlock()
+    for waiter in waiters {
+      waiter(error)
+    }
+  }
+
+  /**
+  Check if an error means a cached planId must not be used again
+  */
+  public static func invalidatesPlanId(_ error: NSError) -> Bool {
+    return error.domain == BlinkUpErrorDomain && error.code == BlinkUpError.planIDInvalid.rawValue
+  }
+
+  private func entries() -> [String: String] {
+    return defaults.dictionary(forKey: defaultsKey) as? [String: String] ?? [:]
+  }
+
+  private func entryKey(_ apiKey: String) -> String {
+    return apiKey + "|" + BUHelper.userIdentifier()
+  }
+}
+
+extension BUConfigId {
+
+  /**
+  Swift specific ConfigId retrieval that reuses a cached planId
+
+  If a planId is cached for the API key it is used for the ConfigId. If the
+  server rejects it as invalid it is removed from the cache and a new plan is
+  requested. A newly generated planId is stored for the next BlinkUp.
+
+  :param: apiKey      The APIKey assigned to you from Electric Imp
+  :param: planIdCache Cache the planId is read from and stored in
+  :param: queue       Queue the handler is called on
+  :param: handler     Closure called when the configuration id is
+    retrieved from the Electric Imp server.
+  */
+  public class func retrieve(apiKey: String, planIdCache: BUPlanIdCache, queue: DispatchQueue = DispatchQueue.main, handler: @escaping (_ response:ConfigIdResponse) -> ()) {
+    guard let planId = planIdCache.planId(forApiKey: apiKey) else {
+      let leadsLookup = planIdCache.joinPlanLookup(forApiKey: apiKey) { (error) -> () in
+        if let error = error {
+          queue.blinkUpAsync {
+            handler(ConfigIdResponse.error(error))
+          }
+        } else {
+          BUConfigId.retrieve(apiKey: apiKey, planIdCache: planIdCache, queue: queue, handler: handler)
+        }
+      }
+      guard leadsLookup else {
+        return
+      }
+
+      _ = BUConfigId(apiKey: apiKey, queue: queue) { (response) -> () in
+        switch response {
+        case .activated(let configId):
+          if let newPlanId = configId.planId {
+            planIdCache.store(newPlanId, forApiKey: apiKey)
+          }
+          planIdCache.finishPlanLookup(forApiKey: apiKey, error: nil)
+        case .error(let error):
+          planIdCache.finishPlanLookup(forApiKey: apiKey, error: error)
+        }
+        handler(response)
+      }
+      return
+    }
+
+    _ = BUConfigId(apiKey: apiKey, planId: planId, queue: queue) { (response) -> () in
+      if case .error(let error) = response, BUPlanIdCache.invalidatesPlanId(error) {
+        planIdCache.invalidate(forApiKey: apiKey)
+        BUConfigId.retrieve(apiKey: apiKey, planIdCache: planIdCache, queue: queue, handler: handler)
+        return
+      }
+      handler(response)
+    }
+  }
+}
+
+extension BUBasicController {
+
+  /**
+  Swift specific initializer that reuses a cached planId
+
+  The planId cached for the API key is used if there is one. Store the
+  planId of the connected device with `planIdCache.store` and call
+  `planIdCache.invalidate` if the BlinkUp fails with `BlinkUpError.planIDInvalid`.
+
+  :param: apiKey      The APIKey assigned to you from Electric Imp
+  :param: planIdCache Cache the planId is read from
+
+  :returns: An initialized BlinkUpController
+  */
+  convenience public init(apiKey: String, planIdCache: BUPlanIdCache) {
+    BUSDK.ensureConfigured()
+    if let planId = planIdCache.planId(forApiKey: apiKey) {
+      self.init(apiKey: apiKey, planId: planId)
+    } else {
+      self.init(apiKey: apiKey)
+    }
+  }
+}
@@ -0,0 +1,226 @@
+//
+//  BUPollingOptions.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+Optional behaviours for a single device poll
+
+Every option is independent and they can be combined freely. From the caller
+inwards they apply in this order:
+
+- cancellationToken: Cancelling it stops the poll and suppresses the handler
+- cache:             A verified configId completes at once, and pollers for
+  the same configId share one upstream poll
+- hostSelector:      The host that issued the ConfigId is released when the
+  poll ends, and a failover is requested if the host failed
+- hostHealth:        Fails fast while the circuit is open and retries server
+  and network errors with backoff
+- verificationQueue, journal: Record the result of the upstream poll. A
+  network error is queued for later verification and a connected device is
+  appended to the journal. Results served by the cache are not recorded again.
+*/
+public struct BUPollingOptions {
+  /// Cache of verified devices to consult and update
+  public var cache: BUDeviceInfoCache?
+  /// Token that stops the poll and suppresses the handler
+  public var cancellationToken: BUCancellationToken?
+  /// Tracker for the impCloud host, enabling fail fast and retries
+  public var hostHealth: BUHostHealth?
+  /// Selector the ConfigId was retrieved with
+  public var hostSelector: BUCloudHostSelector?
+  /// Queue that receives verifications lost to network errors
+  public var verificationQueue: BUVerificationQueue?
+  /// Journal the provisioning is recorded in
+  public var journal: BUProvisioningJournal?
+  /// Name of the station or operator recorded in the journal
+  public var station: String?
+  /// Durations of the phases before polling, such as "token" and "flash". The
+  /// poll duration is added as "poll".
+  public var phaseTimings: [String: TimeInterval]
+
+  public init(cache: BUDeviceInfoCache? = nil, cancellationToken: BUCancellationToken? = nil, hostHealth: BUHostHealth? = nil, hostSelector: BUCloudHostSelector? = nil, verificationQueue: BUVerificationQueue? = nil, journal: BUProvisioningJournal? = nil, station: String? = nil, phaseTimings: [String: TimeInterval] = [:]) {
+    self.cache = cache
+    self.cancellationToken = cancellationToken
+    self.hostHealth = hostHealth
+    self.hostSelector = hostSelector
+    self.verificationQueue = verificationQueue
+    self.journal = journal
+    self.station = station
+    self.phaseTimings = phaseTimings
+  }
+}
+
+/**
+Swift Internal tokens of the polls started with options, keyed by poller, so
+stopPolling(options:) can reach the stages a poll started
+*/
+private enum BUPollingRuns {
+  private static let lock = NSLock()
+  private static var runs = [ObjectIdentifier: (run: BUCancellationToken, upstream: BUCancellationToken)]()
+
+  static func insert(_ poller: BUDevicePoller, run: BUCancellationToken, upstream: BUCancellationToken) {
+    lock.lock()
+    runs[ObjectIdentifier(poller)] = (run, upstream)
+    lock.unlock()
+  }
+
+  static func remove(_ poller: BUDevicePoller) -> (run: BUCancellationToken, upstream: BUCancellationToken)? {
+    lock.lock()
+    defer { lock.unlock() }
+    return runs.removeValue(forKey: ObjectIdentifier(poller))
+  }
+}
+
+extension BUDevicePoller {
+
+  /**
+  Swift specific polling with optional behaviours
+
+  Stop a poll started this way with `stopPolling(options:)` or by cancelling
+  the options' token, not with `stopPolling`, since host health retries and
+  shared polls run on pollers the caller does not see.
+
+  :param: options         Behaviours to apply to the poll
+  :param: queue           Queue the handler is called on
+  :param: responseHandler Closure that is called on success or failure of a BlinkUp attempt
+  */
+  public func startPollingWithHandler(options: BUPollingOptions, queue: DispatchQueue = DispatchQueue.main, _ responseHandler: @escaping (_ response:PollerResponse) -> ()) {
+    // run suppresses this poller's handler, upstream stops the poll it leads
+    let run = BUCancellationToken()
+    let upstream = BUCancellationToken()
+    BUPollingRuns.insert(self, run: run, upstream: upstream)
+
+    let callerToken = options.cancellationToken
+    let handlerId = callerToken?.register {
+      self.stopPolling(options: options)
+    }
+    guard callerToken?.isCancelled != true else {
+      options.hostSelector?.endSession(forConfigId: self.configId.token)
+      return
+    }
+
+    let deliver = { (response: PollerResponse) -> () in
+      queue.blinkUpAsync {
+        guard !run.isCancelled, callerToken?.isCancelled != true else {
+          return
+        }
+        callerToken?.unregister(handlerId)
+        _ = BUPollingRuns.remove(self)
+        responseHandler(response)
+      }
+    }
+
+    guard let cache = options.cache else {
+      pollUpstream(options: options, upstream: upstream, deliver)
+      return
+    }
+    let token = self.configId.token
+    let lookup = cache.lookup(token, poller: self, stop: { upstream.cancel() }, handler: deliver)
+    if let deviceInfo = lookup.deviceInfo {
+      options.hostSelector?.endSession(forConfigId: token)
+      deliver(PollerResponse.responded(deviceInfo))
+      return
+    }
+    guard lookup.shouldPoll else {
+      return
+    }
+    pollUpstream(options: options, upstream: upstream) { (response) -> () in
+      for handler in cache.complete(token, response: response) {
+        handler(response)
+      }
+    }
+  }
+
+  /**
+  Stop a poller started with options
+
+  The handler of this poller will not be called. With a cache the upstream
+  poll is only stopped once no other poller for the same configId is waiting
+  on it. With a host selector the host held by the session is released once
+  the upstream poll stops.
+
+  :param: options The options the poller was started with
+  */
+  public func stopPolling(options: BUPollingOptions) {
+    guard let tokens = BUPollingRuns.remove(self) else {
+      return
+    }
+    tokens.run.cancel()
+    if let cache = options.cache {
+      cache.leave(self.configId.token, poller: self)?()
+    } else {
+      tokens.upstream.cancel()
+    }
+  }
+
+  // The poll behind the cache: host selection around host health around the
+  // SDK poll, with the result recorded before it is handed back
+  private func pollUpstream(options: BUPollingOptions, upstream: BUCancellationToken, _ handler: @escaping (_ response:PollerResponse) -> ()) {
+    let configId = self.configId
+    let pollStartDate = Date()
+    var completion = { (response: PollerResponse) -> () in
+      switch response {
+      case .error(let error):
+        if let verificationQueue = options.verificationQueue, BUVerificationQueue.shouldQueue(error) {
+          verificationQueue.enqueue(configId, pollStartDate: pollStartDate, error: error)
+        }
+      case .responded(let deviceInfo):
+        if let journal = options.journal {
+          var timings = options.phaseTimings
+          timings["poll"] = Date().timeIntervalSince(pollStartDate)
+          journal.append(BUProvisioningRecord(configId: configId, deviceInfo: deviceInfo, station: options.station, phaseTimings: timings))
+        }
+      case .timedOut:
+        break
+      }
+      handler(response)
+    }
+
+    if let hostSelector = options.hostSelector {
+      let host = BUHostHealth.currentHost
+      let token = configId.token
+      // Host health already records the outcome when it tracks the same host
+      let recordsHealth = options.hostHealth !== hostSelector.hostHealth
+      let selectorId = upstream.register {
+        hostSelector.endSession(forConfigId: token)
+      }
+      let recorded = completion
+      completion = { (response: PollerResponse) -> () in
+        upstream.unregister(selectorId)
+        if case .error(let error) = response, BUHostHealth.isHostFailure(error) {
+          if recordsHealth {
+            hostSelector.hostHealth.recordFailure(forHost: host)
+          }
+          hostSelector.failover()
+        } else if recordsHealth {
+          hostSelector.hostHealth.recordSuccess(forHost: host)
+        }
+        hostSelector.endSession(forConfigId: token)
+        recorded(response)
+      }
+    }
+
+    if let hostHealth = options.hostHealth {
+      self.startPollingWithHandler(hostHealth: hostHealth, cancellationToken: upstream, attempt: 0, queue: DispatchQueue.main, completion)
+      return
+    }
+    let pollId = upstream.register { [weak self] in
+      self?.stopPolling()
+    }
+    guard !upstream.isCancelled else {
+      return
+    }
+    self.startPollingWithHandler { (response) -> () in
+      upstream.unregister(pollId)
+      if !upstream.isCancelled {
+        completion(response)
+      }
+    }
+  }
+}
@@ -0,0 +1,321 @@
+//
+//  BUProvisioningBackend.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+/**
+The server side of a BlinkUp as seen by the client: setup tokens and device polls
+
+BUSDKBackend talks to the Electric Imp cloud (or the configured Private
+impCloud) through BUConfigId and BUDevicePoller. BUSimulatedCloud answers in
+process with configurable latency, errors and device check-ins, so load tests
+and integration tests can run offline.
+*/
+public protocol BUProvisioningBackend: AnyObject {
+
+  /**
+  Retrieve a setup token
+
+  :param: apiKey     The APIKey assigned to you from Electric Imp
+  :param: planId     An existing planId, or nil to have one generated
+  :param: completion Closure called with the token or the error
+  */
+  func requestToken(apiKey: String, planId: String?, completion: @escaping (_ result: Result<String, NSError>) -> ())
+
+  /**
+  Poll until the device flashed with a token checks in or the timeout passes
+
+  :param: token      Token previously returned by requestToken
+  :param: timeout    Seconds before the poll times out
+  :param: completion Closure called with the poll result
+  */
+  func poll(token: String, timeout: TimeInterval, completion: @escaping (_ response: BUDevicePoller.PollerResponse) -> ())
+}
+
+/**
+Backend that uses the BlinkUp SDK and therefore the configured impCloud host
+
+Activated ConfigIds are kept until their token is polled. A token that is
+never polled is dropped once `tokenLifetime` has passed, and polling it
+afterwards fails with `BlinkUpError.setupTokenInvalid`.
+*/
+public final class BUSDKBackend: BUProvisioningBackend {
+
+  private struct Entry {
+    let configId: BUConfigId
+    let expiration: Date
+  }
+
+  /// Seconds an activated token is kept waiting to be polled
+  public let tokenLifetime: TimeInterval
+
+  private let lock = NSLock()
+  private var configIds = [String: Entry]()
+
+  /**
+  :param: tokenLifetime Seconds an activated token is kept waiting to be polled
+  */
+  public init(tokenLifetime: TimeInterval = 600) {
+    self.tokenLifetime = tokenLifetime
+  }
+
+  public func requestToken(apiKey: String, planId: String?, completion: @escaping (_ result: Result<String, NSError>) -> ()) {
+    let handler = { [weak self] (response: BUConfigId.ConfigIdResponse) -> () in
+      switch response {
+      case .activated(let configId):
+        self?.store(configId)
+        completion(.success(configId.token))
+      case .error(let error):
+        completion(.failure(error))
+      }
+    }
+    DispatchQueue.main.async {
+      if let planId = planId {
+        _ = BUConfigId(apiKey: apiKey, planId: planId, queue: DispatchQueue.global(), handler: handler)
+      } else {
+        _ = BUConfigId(apiKey: apiKey, queue: DispatchQueue.global(), handler: handler)
+      }
+    }
+  }
+
+  public func poll(token: String, timeout: TimeInterval, completion: @escaping (_ response: BUDevicePoller.PollerResponse) -> ()) {
+    lock.lock()
+    let entry = configIds.removeValue(forKey: token)
+    lock.unlock()
+    guard let activeEntry = entry, activeEntry.expiration > Date() else {
+      let error = NSError(domain: BlinkUpErrorDomain, code: BlinkUpError.setupTokenInvalid.rawValue, userInfo: nil)
+      completion(.error(error))
+      return
+    }
+    DispatchQueue.main.async {
+      let poller = BUDevicePoller(configId: activeEntry.configId)
+      poller.pollTimeout = timeout
+      poller.startPollingWithHandler(queue: DispatchQueue.global(), completion)
+    }
+  }
+
+  // Expired tokens are swept whenever a new one is stored, so the map stays
+  // bounded by the tokens issued within one lifetime
+  private func store(_ configId: BUConfigId) {
+    let now = Date()
+    lock.lock()
+    configIds = configIds.filter { $0.value.expiration > now }
+    configIds[configId.token] = Entry(configId: configId, expiration: now.addingTimeInterval(tokenLifetime))
+    lock.unlock()
+  }
+}
+
+/**
+In-process stand-in for the impCloud plan, setup-token and device-poll endpoints
+*/
+public final class BUSimulatedCloud: BUProvisioningBackend {
+
+  /**
+  Endpoints of the simulated cloud
+  */
+  public enum Endpoint {
+    case plan
+    case token
+    case poll
+  }
+
+  /**
+  Distribution of a simulated delay in seconds
+  */
+  public enum Delay {
+    case constant(TimeInterval)
+    case uniform(TimeInterval, TimeInterval)
+    case exponential(mean: TimeInterval)
+  }
+
+  /**
+  Behaviour of a single endpoint
+  */
+  public struct Behavior {
+    /// Time the server takes to answer a request
+    public var latency: Delay
+    /// Probability in 0...1 that a request fails with errorCode
+    public var errorRate: Double
+    /// Error returned for failed requests
+    public var errorCode: BlinkUpError
+    /// Probability in 0...1 that the connection drops, reported as BlinkUpError.networkError
+    public var dropRate: Double
+
+    public init(latency: Delay = .constant(0.05), errorRate: Double = 0, errorCode: BlinkUpError = .serverResponseFailed, dropRate: Double = 0) {
+      self.latency = latency
+      self.errorRate = errorRate
+      self.errorCode = errorCode
+      self.dropRate = dropRate
+    }
+  }
+
+  /// Seconds between polls of the same token
+  public var pollInterval: TimeInterval = 1
+
+  /// Time from token issue until the flashed device checks in
+  public var checkInDelay = Delay.uniform(5, 15)
+
+  /// Probability in 0...1 that a flashed device ever checks in
+  public var checkInRate = 1.0
+
+  private let queue = DispatchQueue(label: "com.electricimp.blinkup.simulatedcloud")
+  private var behaviors: [Endpoint: Behavior] = [.plan: Behavior(), .token: Behavior(), .poll: Behavior()]
+  private var random: SplitMix64
+  private var checkIns = [String: (deviceInfo: BUDeviceInfo, date: Date)]()
+  private var issuedTokens = Set<String>()
+  private var sequence = 0
+
+  /**
+  :param: seed Seed for the random decisions, so runs can be repeated
+  */
+  public init(seed: UInt64 = 0) {
+    random = SplitMix64(seed: seed)
+  }
+
+  /**
+  Set the behaviour of an endpoint
+  */
+  public func setBehavior(_ behavior: Behavior, for endpoint: Endpoint) {
+    queue.sync {
+      behaviors[endpoint] = behavior
+    }
+  }
+
+  /**
+  Make the device flashed with a token check in now, whatever the configured check-in delay
+  */
+  public func checkIn(token: String) {
+    queue.sync {
+      if let checkIn = checkIns[token] {
+        checkIns[token] = (checkIn.deviceInfo, Date())
+      }
+    }
+  }
+
+  public func requestToken(apiKey: String, planId: String?, completion: @escaping (_ result: Result<String, NSError>) -> ()) {
+    queue.async {
+      guard let planId = planId else {
+        self.respond(.plan) { (error) -> () in
+          if let error = error {
+            completion(.failure(error))
+          } else {
+            self.requestToken(apiKey: apiKey, planId: self.nextIdentifier("plan"), completion: completion)
+          }
+        }
+        return
+      }
+      self.respond(.token) { (error) -> () in
+        if let error = error {
+          completion(.failure(error))
+          return
+        }
+        let token = self.nextIdentifier("token")
+        self.issuedTokens.insert(token)
+        if self.random.nextUnit() < self.checkInRate {
+          let deviceInfo = BUDeviceInfo()
+          deviceInfo.deviceId = self.nextIdentifier("device")
+          deviceInfo.planId = planId
+          deviceInfo.agentURL = URL(string: "https://agent.example.invalid/\(token)")
+          let date = Date(timeIntervalSinceNow: self.sample(self.checkInDelay))
+          deviceInfo.verificationDate = date
+          self.checkIns[token] = (deviceInfo, date)
+        }
+        completion(.success(token))
+      }
+    }
+  }
+
+  public func poll(token: String, timeout: TimeInterval, completion: @escaping (_ response: BUDevicePoller.PollerResponse) -> ()) {
+    queue.async {
+      guard self.issuedTokens.contains(token) else {
+        completion(.error(self.error(.setupTokenInvalid)))
+        return
+      }
+      self.pollOnce(token: token, deadline: Date(timeIntervalSinceNow: timeout), completion: completion)
+    }
+  }
+
+  private func pollOnce(token: String, deadline: Date, completion: @escaping (_ response: BUDevicePoller.PollerResponse) -> ()) {
+    respond(.poll) { (error) -> () in
+      if let error = error {
+        completion(.error(error))
+        return
+      }
+      let now = Date()
+      if let checkIn = self.checkIns[token], checkIn.date <= now {
+        completion(.responded(checkIn.deviceInfo))
+      } else if now.addingTimeInterval(self.pollInterval) >= deadline {
+        completion(.timedOut)
+      } else {
+        self.queue.asyncAfter(deadline: .now() + self.pollInterval) {
+          self.pollOnce(token: token, deadline: deadline, completion: completion)
+        }
+      }
+    }
+  }
+
+  /// Must be called on queue. Calls the closure on queue after the endpoint latency.
+  private func respond(_ endpoint: Endpoint, _ body: @escaping (_ error: NSError?) -> ()) {
+    let behavior = behaviors[endpoint] ?? Behavior()
+    let latency = sample(behavior.latency)
+    let roll = random.nextUnit()
+    var error: NSError?
+    if roll < behavior.dropRate {
+      error = self.error(.networkError)
+    } else if roll < behavior.dropRate + behavior.errorRate {
+      error = self.error(behavior.errorCode)
+    }
+    queue.asyncAfter(deadline: .now() + latency) {
+      body(error)
+    }
+  }
+
+  private func sample(_ delay: Delay) -> TimeInterval {
+    switch delay {
+    case .constant(let value):
+      return value
+    case .uniform(let low, let high):
+      return low + (high - low) * random.nextUnit()
+    case .exponential(let mean):
+      return -mean * log(1 - random.nextUnit())
+    }
+  }
+
+  private func error(_ code: BlinkUpError) -> NSError {
+    return NSError(domain: BlinkUpErrorDomain, code: code.rawValue, userInfo: nil)
+  }
+
+  private func nextIdentifier(_ prefix: String) -> String {
+    sequence += 1
+    return "\(prefix)-\(sequence)"
+  }
+}
+
+/**
+Swift Internal small deterministic random number generator
+*/
+internal struct SplitMix64: RandomNumberGenerator {
+  private var state: UInt64
+
+  init(seed: UInt64) {
+    state = seed
+  }
+
+  mutating func next() -> UInt64 {
+    state = state &+ 0x9E3779B97F4A7C15
+    var z = state
+    z = (z ^ (z >> 30)) &* 0xBF58476D1CE4E5B9
+    z = (z ^ (z >> 27)) &* 0x94D049BB133111EB
+    return z ^ (z >> 31)
+  }
+
+  /// Uniform value in 0..<1
+  mutating func nextUnit() -> Double {
+    return Double(next() >> 11) / Double(1 << 53)
+  }
+}
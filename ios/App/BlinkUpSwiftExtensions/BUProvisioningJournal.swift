@@ -0,0 +1,408 @@
+//
+//  BUProvisioningJournal.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import Darwin
+import BlinkUp
+
+/**
+A completed provisioning, kept for audit and RMA
+*/
+public struct BUProvisioningRecord: Codable {
+  /// Token of the configId that was flashed to the device
+  public let token: String
+  /// Plan the device was added to
+  public let planId: String?
+  /// deviceId of the device that connected
+  public let deviceId: String?
+  /// Agent URL of the device that connected
+  public let agentURL: URL?
+  /// When the server verified the device
+  public let verificationDate: Date?
+  /// Name of the station or operator that performed the BlinkUp
+  public let station: String?
+  /// Duration in seconds of each phase, such as "token", "flash" and "poll"
+  public let phaseTimings: [String: TimeInterval]
+  /// When the record was written
+  public let recordedDate: Date
+
+  public init(token: String, planId: String?, deviceId: String?, agentURL: URL?, verificationDate: Date?, station: String? = nil, phaseTimings: [String: TimeInterval] = [:], recordedDate: Date = Date()) {
+    self.token = token
+    self.planId = planId
+    self.deviceId = deviceId
+    self.agentURL = agentURL
+    self.verificationDate = verificationDate
+    self.station = station
+    self.phaseTimings = phaseTimings
+    self.recordedDate = recordedDate
+  }
+
+  /**
+  Build a record from the configId that was flashed and the device that connected
+  */
+  public init(configId: BUConfigId, deviceInfo: BUDeviceInfo, station: String? = nil, phaseTimings: [String: TimeInterval] = [:]) {
+    self.init(token: configId.token, planId: deviceInfo.planId ?? configId.planId, deviceId: deviceInfo.deviceId, agentURL: deviceInfo.agentURL, verificationDate: deviceInfo.verificationDate, station: station, phaseTimings: phaseTimings)
+  }
+
+  /// Date the record is indexed by: the verification date, or the recorded date without one
+  public var date: Date {
+    return verificationDate ?? recordedDate
+  }
+}
+
+/**
+Durable append-only journal of provisionings
+
+Records are appended to a JSON lines log on an internal queue and the file is
+synchronized before the append completion is called, so a committed record
+survives a crash. A torn final line left by a crash during a write is cut off
+when the journal is opened. I/O failures such as a full disk are reported
+through the completion rather than raised.
+
+Opening the journal is cheap. The log is read in chunks in the background to
+rebuild two indexes of file offsets: one by deviceId and one by date. `count`,
+lookups and exports made before that finishes block until it does, so make
+them off the main thread for a large journal, or check `isIndexed` first.
+Lookups read only the records they return. If the log cannot be read the
+journal stays closed and the file is left untouched: appends fail and lookups
+return nothing.
+Appends arrive in date order almost always, so keeping the date index sorted
+is usually an append.
+*/
+public final class BUProvisioningJournal {
+
+  private struct Location {
+    let date: Date
+    let offset: UInt64
+    let length: Int
+  }
+
+  // Only the fields the indexes need are decoded while rebuilding them
+  private struct IndexKey: Decodable {
+    let deviceId: String?
+    let verificationDate: Date?
+    let recordedDate: Date
+  }
+
+  private let fileURL: URL
+  private let workQueue = DispatchQueue(label: "com.electricimp.blinkup.journal", qos: .utility)
+  private var descriptor: Int32 = -1
+  private var committedLength: UInt64 = 0
+  private var byDeviceId = [String: [Location]]()
+  private var byDate = [Location]()
+  private let stateLock = NSLock()
+  private var indexed = false
+
+  /**
+  Open a journal backed by a log file, creating it if it does not exist. The
+  indexes are rebuilt in the background.
+
+  :param: fileURL Location of the log
+  */
+  public init(fileURL: URL = BUProvisioningJournal.defaultFileURL) {
+    self.fileURL = fileURL
+    workQueue.async {
+      self.open()
+    }
+  }
+
+  deinit {
+    if descriptor >= 0 {
+      close(descriptor)
+    }
+  }
+
+  /**
+  Default location of the log in Application Support
+  */
+  public static var defaultFileURL: URL {
+    let directory = FileManager.default.urls(for: .applicationSupportDirectory, in: .userDomainMask)[0]
+    return directory.appendingPathComponent("BlinkUp", isDirectory: true).appendingPathComponent("provisionings.log")
+  }
+
+  /**
+  True once the indexes have been rebuilt, so calls on the journal no longer
+  wait for the log to be read. Does not block.
+  */
+  public var isIndexed: Bool {
+    stateLock.lock()
+    defer { stateLock.unlock() }
+    return indexed
+  }
+
+  /**
+  True if the log was opened. Blocks until the indexes have been rebuilt.
+  */
+  public var isOpen: Bool {
+    return workQueue.sync { descriptor >= 0 }
+  }
+
+  /**
+  Number of records in the journal. Blocks until the indexes have been rebuilt.
+  */
+  public var count: Int {
+    return workQueue.sync { byDate.count }
+  }
+
+  /**
+  Append a record and synchronize the log in the background
+
+  :param: record     Record to append
+  :param: queue      Queue the completion is called on
+  :param: completion Closure called with true once the record is on disk, or
+    false if it could not be written
+  */
+  public func append(_ record: BUProvisioningRecord, queue: DispatchQueue = DispatchQueue.main, completion: ((_ committed: Bool) -> ())? = nil) {
+    append([record], queue: queue, completion: completion)
+  }
+
+  /**
+  Append several records with a single write and synchronization. A failed
+  write is cut back to the records committed before it. A crash during the
+  write can still leave the first records of the batch complete in the log,
+  and those are read back when the journal is next opened.
+
+  :param: records    Records to append
+  :param: queue      Queue the completion is called on
+  :param: completion Closure called with true once the records are on disk, or
+    false if they could not be written
+  */
+  public func append(_ records: [BUProvisioningRecord], queue: DispatchQueue = DispatchQueue.main, completion: ((_ committed: Bool) -> ())? = nil) {
+    workQueue.async {
+      let committed = self.commit(records)
+      if let completion = completion {
+        queue.async {
+          completion(committed)
+        }
+      }
+    }
+  }
+
+  /**
+  Every record for a deviceId, oldest first. Blocks until the indexes have been rebuilt.
+  */
+  public func records(forDeviceId deviceId: String) -> [BUProvisioningRecord] {
+    return workQueue.sync {
+      read(byDeviceId[deviceId] ?? [])
+    }
+  }
+
+  /**
+  Records for a deviceId dated within a range, oldest first. Blocks until the
+  indexes have been rebuilt.
+  */
+  public func records(forDeviceId deviceId: String, from start: Date, to end: Date) -> [BUProvisioningRecord] {
+    return workQueue.sync {
+      let locations = byDeviceId[deviceId] ?? []
+      return read(locations[BUProvisioningJournal.range(of: locations, from: start, to: end)])
+    }
+  }
+
+  /**
+  Records dated within a range, oldest first. Blocks until the indexes have
+  been rebuilt.
+  */
+  public func records(from start: Date, to end: Date) -> [BUProvisioningRecord] {
+    return workQueue.sync {
+      read(byDate[BUProvisioningJournal.range(of: byDate, from: start, to: end)])
+    }
+  }
+
+  /**
+  Write every committed record to a stream as JSON lines without loading the
+  journal into memory. Blocks until the indexes have been rebuilt.
+
+  :param: stream Open stream the records are written to
+
+  :returns: True if the whole journal was written
+  */
+  @discardableResult
+  public func export(to stream: OutputStream) -> Bool {
+    return workQueue.sync {
+      guard descriptor >= 0 else {
+        return false
+      }
+      var chunk = [UInt8](repeating: 0, count: 64 * 1024)
+      var offset: UInt64 = 0
+      while offset < committedLength {
+        let wanted = Int(min(committedLength - offset, UInt64(chunk.count)))
+        let count = pread(descriptor, &chunk, wanted, off_t(offset))
+        guard count > 0 else {
+          return false
+        }
+        var sent = 0
+        while sent < count {
+          let result = chunk.withUnsafeBufferPointer { stream.write($0.baseAddress! + sent, maxLength: count - sent) }
+          guard result > 0 else {
+            return false
+          }
+          sent += result
+        }
+        offset += UInt64(count)
+      }
+      return true
+    }
+  }
+
+  private func commit(_ records: [BUProvisioningRecord]) -> Bool {
+    guard descriptor >= 0 else {
+      return false
+    }
+    let encoder = JSONEncoder()
+    var data = Data()
+    var locations = [(deviceId: String?, location: Location)]()
+    for record in records {
+      guard var line = try? encoder.encode(record) else {
+        return false
+      }
+      line.append(UInt8(ascii: "\n"))
+      locations.append((record.deviceId, Location(date: record.date, offset: committedLength + UInt64(data.count), length: line.count)))
+      data.append(line)
+    }
+
+    let written = data.withUnsafeBytes { (buffer) -> Bool in
+      var sent = 0
+      while sent < buffer.count {
+        let result = pwrite(descriptor, buffer.baseAddress! + sent, buffer.count - sent, off_t(committedLength) + off_t(sent))
+        guard result > 0 else {
+          return false
+        }
+        sent += result
+      }
+      return true
+    }
+    guard written, fsync(descriptor) == 0 else {
+      // Drop whatever part of the batch reached the file
+      ftruncate(descriptor, off_t(committedLength))
+      return false
+    }
+    committedLength += UInt64(data.count)
+    for entry in locations {
+      index(entry.location, deviceId: entry.deviceId)
+    }
+    return true
+  }
+
+  private func open() {
+    defer {
+      stateLock.lock()
+      indexed = true
+      stateLock.unlock()
+    }
+    try? FileManager.default.createDirectory(at: fileURL.deletingLastPathComponent(), withIntermediateDirectories: true, attributes: nil)
+    let file = Darwin.open(fileURL.path, O_RDWR | O_CREAT, 0o644)
+    guard file >= 0 else {
+      return
+    }
+    guard let length = scan(file) else {
+      // Nothing is known about the tail of a log that could not be read, so it
+      // is left as it is rather than cut
+      byDeviceId.removeAll()
+      byDate.removeAll()
+      close(file)
+      return
+    }
+
+    // A torn final line from a crash mid-write is cut off
+    var status = stat()
+    if fstat(file, &status) == 0 && UInt64(status.st_size) > length {
+      ftruncate(file, off_t(length))
+    }
+    committedLength = length
+    descriptor = file
+  }
+
+  // Indexes every complete line of the log, reading it a chunk at a time.
+  // Returns the length up to the end of the last complete line, or nil if the
+  // log could not be read.
+  private func scan(_ file: Int32) -> UInt64? {
+    let decoder = JSONDecoder()
+    let newlineByte = UInt8(ascii: "\n")
+    var chunk = [UInt8](repeating: 0, count: 1024 * 1024)
+    var line = Data()
+    var lineStart: UInt64 = 0
+    var offset: UInt64 = 0
+    while true {
+      let count = pread(file, &chunk, chunk.count, off_t(offset))
+      if count < 0 {
+        if errno == EINTR {
+          continue
+        }
+        return nil
+      }
+      if count == 0 {
+        return lineStart
+      }
+      var start = 0
+      while let newline = chunk[start..<count].firstIndex(of: newlineByte) {
+        line.append(contentsOf: chunk[start..<newline])
+        let lineEnd = offset + UInt64(newline) + 1
+        if let key = try? decoder.decode(IndexKey.self, from: line) {
+          index(Location(date: key.verificationDate ?? key.recordedDate, offset: lineStart, length: Int(lineEnd - lineStart)), deviceId: key.deviceId)
+        }
+        line.removeAll(keepingCapacity: true)
+        lineStart = lineEnd
+        start = newline + 1
+      }
+      line.append(contentsOf: chunk[start..<count])
+      offset += UInt64(count)
+    }
+  }
+
+  private func index(_ location: Location, deviceId: String?) {
+    if let deviceId = deviceId {
+      BUProvisioningJournal.insert(location, into: &byDeviceId[deviceId, default: []])
+    }
+    BUProvisioningJournal.insert(location, into: &byDate)
+  }
+
+  private func read<C: Collection>(_ locations: C) -> [BUProvisioningRecord] where C.Element == Location {
+    guard descriptor >= 0 else {
+      return []
+    }
+    let decoder = JSONDecoder()
+    return locations.compactMap { (location) -> BUProvisioningRecord? in
+      var line = Data(count: location.length)
+      let count = line.withUnsafeMutableBytes { pread(descriptor, $0.baseAddress!, location.length, off_t(location.offset)) }
+      guard count == location.length else {
+        return nil
+      }
+      return try? decoder.decode(BUProvisioningRecord.self, from: line)
+    }
+  }
+
+  private static func insert(_ location: Location, into locations: inout [Location]) {
+    if let last = locations.last, location.date < last.date {
+      locations.insert(location, at: firstIndex(in: locations, notBefore: location.date, orAfter: true))
+    } else {
+      locations.append(location)
+    }
+  }
+
+  private static func range(of locations: [Location], from start: Date, to end: Date) -> Range<Int> {
+    let lower = firstIndex(in: locations, notBefore: start, orAfter: false)
+    let upper = firstIndex(in: locations, notBefore: end, orAfter: true)
+    return lower..<max(lower, upper)
+  }
+
+  // Binary search for the first location dated at or after the date, or
+  // strictly after it when orAfter is true
+  private static func firstIndex(in locations: [Location], notBefore date: Date, orAfter: Bool) -> Int {
+    var low = 0
+    var high = locations.count
+    while low < high {
+      let middle = (low + high) / 2
+      let before = orAfter ? locations[middle].date <= date : locations[middle].date < date
+      if before {
+        low = middle + 1
+      } else {
+        high = middle
+      }
+    }
+    return low
+  }
+}
@@ -0,0 +1,145 @@
+//
+//  BUSDK.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import BlinkUp
+
+extension BUSDK {
+
+  /**
+  Record the SDK configuration without applying it
+
+  This can be called from `application:didFinishLaunchingWithOptions:` in
+  place of the `configure` methods. The configuration is applied on the main
+  thread on the first use of a Swift extension method, or earlier by
+  `warmUp()`. Pinning descriptions are built by a closure so their SPKI data
+  is not decoded at launch.
+
+  :param: privateCloudHost    Server host to connect to, or nil for the Electric Imp cloud
+  :param: pinningDescriptions Closure building the SSL pinning descriptions for the host
+  :param: featureCodes        All of the features codes that should be enabled
+  :param: apiKey              The API Key assigned to you from Electric Imp, required for feature codes
+  */
+  public class func configureLazily(privateCloudHost: String? = nil, pinningDescriptions: (() -> [BUPinningDescription])? = nil, featureCodes: [String] = [], apiKey: String? = nil) {
+    BULazyConfiguration.shared.record(BULazyConfiguration.Parameters(privateCloudHost: privateCloudHost, pinningDescriptions: pinningDescriptions, featureCodes: featureCodes, apiKey: apiKey))
+  }
+
+  /**
+  Apply a configuration recorded by `configureLazily` if it has not been applied yet.
+  Does nothing when the SDK was configured directly. The SDK expects configure
+  on the main thread, so a call from another thread waits for the main queue,
+  but only while a recorded configuration is still waiting to be applied.
+
+  :returns: The list of feature names that were enabled
+  */
+  @discardableResult
+  public class func ensureConfigured() -> [String] {
+    guard !Thread.isMainThread else {
+      return BULazyConfiguration.shared.apply()
+    }
+    guard BULazyConfiguration.shared.isPending else {
+      return BULazyConfiguration.shared.features
+    }
+    return DispatchQueue.main.sync {
+      BULazyConfiguration.shared.apply()
+    }
+  }
+
+  /**
+  Apply a configuration recorded by `configureLazily` on a later turn of the
+  main run loop, typically called once the first screen has been presented
+  */
+  public class func warmUp() {
+    DispatchQueue.main.async {
+      BULazyConfiguration.shared.apply()
+    }
+  }
+
+  /**
+  Seconds spent applying the recorded configuration, or nil if it has not been applied
+  */
+  public class var lazyConfigurationDuration: TimeInterval? {
+    return BULazyConfiguration.shared.duration
+  }
+}
+
+/**
+Swift Internal storage for a configuration recorded by `BUSDK.configureLazily`
+*/
+internal final class BULazyConfiguration {
+  static let shared = BULazyConfiguration()
+
+  struct Parameters {
+    let privateCloudHost: String?
+    let pinningDescriptions: (() -> [BUPinningDescription])?
+    let featureCodes: [String]
+    let apiKey: String?
+    /// Reset the SDK before configuring it, to replace a host already in use
+    var replacesConfiguration = false
+  }
+
+  private let lock = NSLock()
+  private var parameters: Parameters?
+  private var enabledFeatures = [String]()
+  private var applyDuration: TimeInterval?
+
+  var duration: TimeInterval? {
+    lock.lock()
+    defer { lock.unlock() }
+    return applyDuration
+  }
+
+  var isPending: Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return parameters != nil
+  }
+
+  var features: [String] {
+    lock.lock()
+    defer { lock.unlock() }
+    return enabledFeatures
+  }
+
+  func record(_ parameters: Parameters) {
+    lock.lock()
+    defer { lock.unlock() }
+    self.parameters = parameters
+    applyDuration = nil
+  }
+
+  @discardableResult
+  func apply() -> [String] {
+    lock.lock()
+    defer { lock.unlock() }
+    guard let parameters = parameters else {
+      return enabledFeatures
+    }
+    self.parameters = nil
+
+    let start = Date()
+    if parameters.replacesConfiguration {
+      BUSDK.resetToDefaults()
+    }
+    let apiKey = parameters.apiKey ?? ""
+    let wantsFeatures = !parameters.featureCodes.isEmpty && parameters.apiKey != nil
+    if let host = parameters.privateCloudHost {
+      let pins = parameters.pinningDescriptions?() ?? []
+      if wantsFeatures {
+        enabledFeatures = BUSDK.configure(withPrivateCloudHost: host, pinningDescriptions: pins, featureCodes: parameters.featureCodes, apiKey: apiKey)
+      } else {
+        BUSDK.configure(withPrivateCloudHost: host, pinningDescriptions: pins)
+      }
+    } else if wantsFeatures {
+      enabledFeatures = BUSDK.configure(withFeatureCodes: parameters.featureCodes, apiKey: apiKey)
+    } else {
+      BUSDK.configure()
+    }
+    applyDuration = Date().timeIntervalSince(start)
+    return enabledFeatures
+  }
+}
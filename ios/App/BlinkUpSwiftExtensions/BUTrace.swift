@@ -0,0 +1,205 @@
+//
+//  BUTrace.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import os.signpost
+
+/**
+Swift Internal trace point. Without the BLINKUP_TRACE compilation condition
+the body is empty and, being always inlined with static arguments, the call
+leaves nothing behind in optimized builds.
+
+Events with an id are asynchronous: they are matched by id rather than by
+nesting on the emitting thread, so a flow that ends without its end event,
+such as a controller dismissed with forceDismiss, leaves one open interval
+instead of unbalancing every later event on the thread.
+*/
+@inline(__always)
+internal func buTrace(_ name: StaticString, _ phase: BUTraceEvent.Phase, id: UInt64 = 0) {
+  #if BLINKUP_TRACE
+  BUTrace.emit(name, phase, id: id)
+  #endif
+}
+
+/**
+Swift Internal id grouping the asynchronous trace events of one object.
+Always 0 without the BLINKUP_TRACE compilation condition.
+*/
+@inline(__always)
+internal func buTraceId(_ object: AnyObject) -> UInt64 {
+  #if BLINKUP_TRACE
+  return UInt64(UInt(bitPattern: ObjectIdentifier(object)))
+  #else
+  return 0
+  #endif
+}
+
+/**
+A trace event passed to a sink
+*/
+public struct BUTraceEvent {
+  /**
+  Swift enumeration of event phases
+
+  - Begin:   A stage started
+  - End:     The most recent stage of the same name ended
+  - Instant: Something happened at a single point in time
+  */
+  public enum Phase {
+    case begin
+    case end
+    case instant
+  }
+
+  /// Name of the stage, such as "BUBasicController.poll"
+  public let name: StaticString
+  public let phase: Phase
+  /// Nanoseconds since boot
+  public let timestamp: UInt64
+  /// Mach thread the event was emitted on
+  public let threadId: UInt32
+  /// Id matching the begin and end of an asynchronous stage, or nil for a stage
+  /// that begins and ends on one thread
+  public let id: UInt64?
+}
+
+#if BLINKUP_TRACE
+
+/**
+Receives trace events. Events arrive on the thread that emitted them.
+*/
+public protocol BUTraceSink: AnyObject {
+  func record(_ event: BUTraceEvent)
+}
+
+/**
+Trace points compiled in with the BLINKUP_TRACE compilation condition
+
+Add BLINKUP_TRACE to `SWIFT_ACTIVE_COMPILATION_CONDITIONS` to compile the
+trace points in and set `sink` to collect them.
+*/
+public enum BUTrace {
+  private static let lock = NSLock()
+  private static var currentSink: BUTraceSink?
+
+  /**
+  Sink events are sent to, or nil to drop them
+  */
+  public static var sink: BUTraceSink? {
+    get {
+      lock.lock()
+      defer { lock.unlock() }
+      return currentSink
+    }
+    set {
+      lock.lock()
+      defer { lock.unlock() }
+      currentSink = newValue
+    }
+  }
+
+  internal static func emit(_ name: StaticString, _ phase: BUTraceEvent.Phase, id: UInt64) {
+    guard let sink = sink else {
+      return
+    }
+    sink.record(BUTraceEvent(name: name, phase: phase, timestamp: DispatchTime.now().uptimeNanoseconds, threadId: pthread_mach_thread_np(pthread_self()), id: id == 0 ? nil : id))
+  }
+}
+
+/**
+Collects events in the Chrome trace event format, for chrome://tracing or Perfetto
+*/
+public final class BUChromeTraceSink: BUTraceSink {
+  private let lock = NSLock()
+  private var events = [BUTraceEvent]()
+
+  public init() {}
+
+  public func record(_ event: BUTraceEvent) {
+    lock.lock()
+    events.append(event)
+    lock.unlock()
+  }
+
+  /**
+  Remove every collected event
+  */
+  public func reset() {
+    lock.lock()
+    events.removeAll()
+    lock.unlock()
+  }
+
+  /**
+  The collected events as a Chrome trace JSON document
+  */
+  public func data() -> Data {
+    lock.lock()
+    let collected = events
+    lock.unlock()
+
+    let pid = ProcessInfo.processInfo.processIdentifier
+    let traceEvents = collected.map { (event) -> [String: Any] in
+      var entry: [String: Any] = ["name": event.name.description, "ts": Double(event.timestamp) / 1000, "pid": pid, "tid": event.threadId]
+      if let id = event.id {
+        entry["cat"] = "blinkup"
+        entry["id"] = String(id, radix: 16)
+        switch event.phase {
+        case .begin:
+          entry["ph"] = "b"
+        case .end:
+          entry["ph"] = "e"
+        case .instant:
+          entry["ph"] = "n"
+        }
+      } else {
+        switch event.phase {
+        case .begin:
+          entry["ph"] = "B"
+        case .end:
+          entry["ph"] = "E"
+        case .instant:
+          entry["ph"] = "i"
+        }
+      }
+      return entry
+    }
+    return (try? JSONSerialization.data(withJSONObject: ["traceEvents": traceEvents], options: [])) ?? Data()
+  }
+
+  /**
+  Write the collected events to a file
+  */
+  public func write(to url: URL) throws {
+    try data().write(to: url, options: .atomic)
+  }
+}
+
+/**
+Forwards events to os_signpost, so stages appear as intervals in Instruments
+*/
+public final class BUSignpostSink: BUTraceSink {
+  private let log: OSLog
+
+  public init(subsystem: String = "com.electricimp.blinkup", category: String = "BlinkUp") {
+    log = OSLog(subsystem: subsystem, category: category)
+  }
+
+  public func record(_ event: BUTraceEvent) {
+    let signpostID = event.id.map { OSSignpostID($0) } ?? OSSignpostID.exclusive
+    switch event.phase {
+    case .begin:
+      os_signpost(.begin, log: log, name: event.name, signpostID: signpostID)
+    case .end:
+      os_signpost(.end, log: log, name: event.name, signpostID: signpostID)
+    case .instant:
+      os_signpost(.event, log: log, name: event.name, signpostID: signpostID)
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,345 @@
+//
+//  BUVerificationQueue.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+import Foundation
+import Darwin
+import Network
+import BlinkUp
+
+/**
+A verification that could not be completed because the network failed while polling
+*/
+public struct BUVerificationRecord: Codable {
+  /// Token of the configId that was flashed to the device
+  public let token: String
+  /// Plan the configId belongs to, if known
+  public let planId: String?
+  /// When polling for the device started
+  public let pollStartDate: Date
+  /// When polling failed
+  public let failureDate: Date
+  /// Code of the error that caused the verification to be queued
+  public let errorCode: Int
+}
+
+/**
+Durable queue of verifications that failed with `BlinkUpError.networkError`
+
+Failed verifications are appended to a log on disk. When connectivity returns
+the queue polls for them again in batches and delivers the results through
+`lateCompletionHandler` on `completionQueue`.
+
+A BUConfigId cannot be rebuilt from its token, so only verifications queued
+during the current launch can be polled again. Records left over from a
+previous launch are delivered once as `unrecoverable`.
+*/
+public final class BUVerificationQueue {
+
+  /**
+  Swift enumeration of late verification results
+
+  - Polled:        The verification was polled again with this result
+  - Unrecoverable: The configId is no longer available and cannot be polled
+  */
+  public enum LateResponse {
+    case polled(BUDevicePoller.PollerResponse)
+    case unrecoverable
+  }
+
+  /**
+  Counters describing the work done by the queue
+  */
+  public struct Statistics {
+    /// Verifications added to the queue
+    public var queued = 0
+    /// Verifications that resolved to a connected device on replay
+    public var recovered = 0
+    /// Verifications polled again, whatever their result
+    public var replayed = 0
+    /// Total time spent in replay batches
+    public var replayDuration: TimeInterval = 0
+  }
+
+  private struct LogEntry: Codable {
+    let resolved: Bool
+    let record: BUVerificationRecord
+  }
+
+  /**
+  Closure called on `completionQueue` for every verification resolved by a
+  replay. Safe to set from any thread.
+  */
+  public var lateCompletionHandler: ((_ record: BUVerificationRecord, _ response: LateResponse) -> ())? {
+    get {
+      handlerLock.lock()
+      defer { handlerLock.unlock() }
+      return handler
+    }
+    set {
+      handlerLock.lock()
+      defer { handlerLock.unlock() }
+      handler = newValue
+    }
+  }
+
+  /// Number of verifications polled at the same time during a replay
+  public let batchSize: Int
+
+  /// pollTimeout used for pollers created during a replay
+  public let replayPollTimeout: TimeInterval
+
+  /// Queue `lateCompletionHandler` is called on
+  public let completionQueue: DispatchQueue
+
+  private let handlerLock = NSLock()
+  private var handler: ((_ record: BUVerificationRecord, _ response: LateResponse) -> ())?
+  private let fileURL: URL
+  private let workQueue = DispatchQueue(label: "com.electricimp.blinkup.verificationqueue")
+  private var pending = [String: BUVerificationRecord]()
+  private var configIds = [String: BUConfigId]()
+  private var stats = Statistics()
+  private var isReplaying = false
+  private var pathMonitor: NWPathMonitor?
+
+  /**
+  Create a queue backed by a log file. Records pending in the file are loaded immediately.
+
+  :param: fileURL           Location of the log, created if it does not exist
+  :param: batchSize         Number of verifications polled at the same time during a replay
+  :param: replayPollTimeout pollTimeout used for pollers created during a replay
+  :param: completionQueue   Queue `lateCompletionHandler` is called on
+  */
+  public init(fileURL: URL = BUVerificationQueue.defaultFileURL, batchSize: Int = 8, replayPollTimeout: TimeInterval = 15, completionQueue: DispatchQueue = DispatchQueue.main) {
+    self.fileURL = fileURL
+    self.batchSize = max(1, batchSize)
+    self.replayPollTimeout = replayPollTimeout
+    self.completionQueue = completionQueue
+    workQueue.sync {
+      self.load()
+    }
+  }
+
+  /**
+  Default location of the log in Application Support
+  */
+  public static var defaultFileURL: URL {
+    let directory = FileManager.default.urls(for: .applicationSupportDirectory, in: .userDomainMask)[0]
+    return directory.appendingPathComponent("BlinkUp", isDirectory: true).appendingPathComponent("verifications.log")
+  }
+
+  /**
+  Check if an error should cause a verification to be queued
+  */
+  public static func shouldQueue(_ error: NSError) -> Bool {
+    return error.domain == BlinkUpErrorDomain && error.code == BlinkUpError.networkError.rawValue
+  }
+
+  /**
+  Verifications waiting to be replayed
+  */
+  public var pendingRecords: [BUVerificationRecord] {
+    return workQueue.sync { Array(pending.values) }
+  }
+
+  /**
+  Counters describing the work done by the queue
+  */
+  public var statistics: Statistics {
+    return workQueue.sync { stats }
+  }
+
+  /**
+  Add a failed verification to the queue
+
+  :param: configId      ConfigId that was flashed to the device
+  :param: pollStartDate When polling for the device started
+  :param: error         Error that caused polling to fail
+  */
+  public func enqueue(_ configId: BUConfigId, pollStartDate: Date, error: NSError) {
+    let record = BUVerificationRecord(token: configId.token, planId: configId.planId, pollStartDate: pollStartDate, failureDate: Date(), errorCode: error.code)
+    workQueue.async {
+      self.pending[record.token] = record
+      self.configIds[record.token] = configId
+      self.stats.queued += 1
+      self.append(LogEntry(resolved: false, record: record))
+    }
+  }
+
+  /**
+  Replay queued verifications when the network path becomes available
+  */
+  public func startMonitoring() {
+    workQueue.async {
+      guard self.pathMonitor == nil else {
+        return
+      }
+      let monitor = NWPathMonitor()
+      monitor.pathUpdateHandler = { [weak self] (path) -> Void in
+        if path.status == .satisfied {
+          self?.replay()
+        }
+      }
+      monitor.start(queue: self.workQueue)
+      self.pathMonitor = monitor
+    }
+  }
+
+  /**
+  Stop replaying automatically when connectivity returns
+  */
+  public func stopMonitoring() {
+    workQueue.async {
+      self.pathMonitor?.cancel()
+      self.pathMonitor = nil
+    }
+  }
+
+  /**
+  Poll again for every queued verification, `batchSize` at a time. A replay
+  stops early if the network fails again.
+  */
+  public func replay() {
+    workQueue.async {
+      guard !self.isReplaying, !self.pending.isEmpty else {
+        return
+      }
+      self.isReplaying = true
+      self.replayBatch(Array(self.pending.values).sorted { $0.failureDate < $1.failureDate })
+    }
+  }
+
+  private func replayBatch(_ remaining: [BUVerificationRecord]) {
+    guard !remaining.isEmpty else {
+      finishReplay()
+      return
+    }
+
+    let batch = remaining.prefix(batchSize)
+    let batchStart = Date()
+    let group = DispatchGroup()
+    var networkFailed = false
+
+    for record in batch {
+      guard let configId = configIds[record.token] else {
+        resolve(record, response: LateResponse.unrecoverable)
+        continue
+      }
+      group.enter()
+      DispatchQueue.main.async {
+        let poller = BUDevicePoller(configId: configId)
+        poller.pollTimeout = self.replayPollTimeout
+        poller.startPollingWithHandler(queue: self.workQueue) { (response) -> () in
+          self.stats.replayed += 1
+          if case .error(let error) = response, BUVerificationQueue.shouldQueue(error) {
+            networkFailed = true
+          } else {
+            self.resolve(record, response: LateResponse.polled(response))
+          }
+          group.leave()
+        }
+      }
+    }
+
+    group.notify(queue: workQueue) {
+      self.stats.replayDuration += Date().timeIntervalSince(batchStart)
+      self.compact()
+      if networkFailed {
+        self.finishReplay()
+      } else {
+        self.replayBatch(Array(remaining.dropFirst(batch.count)))
+      }
+    }
+  }
+
+  private func finishReplay() {
+    isReplaying = false
+  }
+
+  // Rewrites the log with only the pending records after each batch, so the
+  // resolved entries do not pile up while new failures keep the queue busy
+  private func compact() {
+    guard !pending.isEmpty else {
+      try? FileManager.default.removeItem(at: fileURL)
+      return
+    }
+    let encoder = JSONEncoder()
+    var data = Data()
+    for record in pending.values.sorted(by: { $0.failureDate < $1.failureDate }) {
+      guard let line = try? encoder.encode(LogEntry(resolved: false, record: record)) else {
+        continue
+      }
+      data.append(line)
+      data.append(UInt8(ascii: "\n"))
+    }
+    try? data.write(to: fileURL, options: .atomic)
+  }
+
+  private func resolve(_ record: BUVerificationRecord, response: LateResponse) {
+    pending[record.token] = nil
+    configIds[record.token] = nil
+    if case .polled(.responded(_)) = response {
+      stats.recovered += 1
+    }
+    append(LogEntry(resolved: true, record: record))
+
+    guard let handler = lateCompletionHandler else {
+      return
+    }
+    completionQueue.async {
+      handler(record, response)
+    }
+  }
+
+  private func load() {
+    guard let data = try? Data(contentsOf: fileURL) else {
+      return
+    }
+    let decoder = JSONDecoder()
+    for line in data.split(separator: UInt8(ascii: "\n")) {
+      // A torn final line from a crash mid-write is skipped
+      guard let entry = try? decoder.decode(LogEntry.self, from: Data(line)) else {
+        continue
+      }
+      pending[entry.record.token] = entry.resolved ? nil : entry.record
+    }
+  }
+
+  // POSIX calls report I/O errors such as a full disk through their return
+  // value; FileHandle would raise an Objective-C exception instead. A record
+  // that cannot be written is still queued for this launch.
+  private func append(_ entry: LogEntry) {
+    guard var line = try? JSONEncoder().encode(entry) else {
+      return
+    }
+    line.append(UInt8(ascii: "\n"))
+
+    try? FileManager.default.createDirectory(at: fileURL.deletingLastPathComponent(), withIntermediateDirectories: true, attributes: nil)
+    let descriptor = open(fileURL.path, O_WRONLY | O_CREAT | O_APPEND, 0o644)
+    guard descriptor >= 0 else {
+      return
+    }
+    defer { close(descriptor) }
+    let originalLength = lseek(descriptor, 0, SEEK_END)
+    let written = line.withUnsafeBytes { (buffer) -> Bool in
+      var sent = 0
+      while sent < buffer.count {
+        let result = write(descriptor, buffer.baseAddress! + sent, buffer.count - sent)
+        guard result > 0 else {
+          return false
+        }
+        sent += result
+      }
+      return true
+    }
+    if written {
+      fsync(descriptor)
+    } else if originalLength >= 0 {
+      // A partial line would corrupt the next record appended after it
+      ftruncate(descriptor, originalLength)
+    }
+  }
+}
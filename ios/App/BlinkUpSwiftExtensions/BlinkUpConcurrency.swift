@@ -0,0 +1,175 @@
+//
+//  BlinkUpConcurrency.swift
+//  BlinkUpSwiftSDK
+//
+//  Copyright © 2020 Twilio Inc. All rights reserved.
+//
+
+#if compiler(>=5.7) && canImport(_Concurrency)
+
+import Foundation
+import BlinkUp
+
+/**
+Swift Internal one-shot bridge between an SDK completion block and task cancellation.
+Whichever of completion or cancellation happens first resumes the continuation.
+*/
+@available(iOS 13.0, *)
+internal final class BUContinuationGate<T> {
+  private let lock = NSLock()
+  private var continuation: CheckedContinuation<T, Error>?
+  private var isCancelled = false
+
+  func install(_ continuation: CheckedContinuation<T, Error>) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    if isCancelled {
+      continuation.resume(throwing: CancellationError())
+      return false
+    }
+    self.continuation = continuation
+    return true
+  }
+
+  func resume(_ result: Result<T, Error>) {
+    lock.lock()
+    let pending = continuation
+    continuation = nil
+    lock.unlock()
+    pending?.resume(with: result)
+  }
+
+  func cancel() {
+    lock.lock()
+    isCancelled = true
+    let pending = continuation
+    continuation = nil
+    lock.unlock()
+    pending?.resume(throwing: CancellationError())
+  }
+}
+
+@available(iOS 13.0, *)
+extension BUConfigId {
+
+  /**
+  Swift concurrency method for retrieving an active ConfigId
+
+  Cancelling the task throws `CancellationError` immediately. The SDK request
+  cannot be stopped, so its result is discarded when it arrives.
+
+  :param: apiKey The APIKey assigned to you from Electric Imp
+  :param: planId An existing planId, or nil to have one generated
+
+  :returns: The activated ConfigId
+  */
+  public static func activated(apiKey: String, planId: String? = nil) async throws -> BUConfigId {
+    let gate = BUContinuationGate<BUConfigId>()
+    return try await withTaskCancellationHandler(operation: {
+      try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<BUConfigId, Error>) -> Void in
+        guard gate.install(continuation) else {
+          return
+        }
+        // SDK requests are started on the main queue, as at the other call sites
+        DispatchQueue.main.async {
+          var request: BUConfigId?
+          let handler = { (response: ConfigIdResponse) -> () in
+            // The request is kept alive until the SDK reports back
+            withExtendedLifetime(request) {}
+            request = nil
+            switch response {
+            case .activated(let configId):
+              gate.resume(.success(configId))
+            case .error(let error):
+              gate.resume(.failure(error))
+            }
+          }
+          if let planId = planId {
+            request = BUConfigId(apiKey: apiKey, planId: planId, queue: DispatchQueue.global(), handler: handler)
+          } else {
+            request = BUConfigId(apiKey: apiKey, queue: DispatchQueue.global(), handler: handler)
+          }
+        }
+      }
+    }, onCancel: {
+      gate.cancel()
+    })
+  }
+}
+
+@available(iOS 13.0, *)
+extension BUFlashController {
+
+  /**
+  Swift concurrency method for performing a BlinkUp
+
+  The flash itself cannot be interrupted once presented, so cancellation is
+  only observed by the caller after the flash returns control.
+
+  :param: networkConfig The WifiConfig, WpsConfig, or ClearConfig that is to
+    be performed.
+  :param: configId      The single use configId for this flashing session. This
+    can be nil in the case of clearing a device
+  :param: animated      Should the presentation be animated
+
+  :returns: The poller for the flashed device, or nil if no poller was created
+  */
+  @MainActor
+  public func presentFlash(with networkConfig: BUNetworkConfig, configId: BUConfigId?, animated: Bool) async throws -> BUDevicePoller? {
+    return try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<BUDevicePoller?, Error>) -> Void in
+      self.presentFlashWithNetworkConfig(networkConfig, configId: configId, animated: animated) { (response) -> () in
+        switch response {
+        case .error(let error):
+          continuation.resume(throwing: error)
+        case .completedWithoutPoller:
+          continuation.resume(returning: nil)
+        case .completedWithPoller(let poller):
+          continuation.resume(returning: poller)
+        }
+      }
+    }
+  }
+}
+
+@available(iOS 13.0, *)
+extension BUDevicePoller {
+
+  /**
+  Swift concurrency method for polling to see if a device connected
+
+  Cancelling the task stops the poller and throws `CancellationError`.
+
+  :returns: Information about the device, or nil if the poller timed out
+  */
+  public func pollForDevice() async throws -> BUDeviceInfo? {
+    let gate = BUContinuationGate<BUDeviceInfo?>()
+    return try await withTaskCancellationHandler(operation: {
+      try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<BUDeviceInfo?, Error>) -> Void in
+        guard gate.install(continuation) else {
+          return
+        }
+        // Started on the main queue, as at the other call sites, so a
+        // cancellation's stopPolling is queued behind it
+        DispatchQueue.main.async {
+          self.startPollingWithHandler(queue: DispatchQueue.global()) { (response) -> () in
+            switch response {
+            case .responded(let deviceInfo):
+              gate.resume(.success(deviceInfo))
+            case .timedOut:
+              gate.resume(.success(nil))
+            case .error(let error):
+              gate.resume(.failure(error))
+            }
+          }
+        }
+      }
+    }, onCancel: {
+      gate.cancel()
+      DispatchQueue.main.async {
+        self.stopPolling()
+      }
+    })
+  }
+}
+
+#endif
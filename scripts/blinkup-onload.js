@@ -0,0 +1,21 @@
+// Keeps the BlinkUp plugin lazily loaded after `npx cap sync`, which
+// regenerates ios/App/App/config.xml from the plugin's plugin.xml
+const fs = require('fs');
+const path = require('path');
+
+const configPath = path.join(__dirname, '..', 'ios', 'App', 'App', 'config.xml');
+if (!fs.existsSync(configPath)) {
+  process.exit(0);
+}
+
+const config = fs.readFileSync(configPath, 'utf8');
+const updated = config.replace(/(<feature name="BlinkUp">)([\s\S]*?)(<\/feature>)/, (match, open, body, close) => {
+  if (/<param name="onload"/.test(body)) {
+    return open + body.replace(/(<param name="onload" value=")[^"]*(")/, '$1false$2') + close;
+  }
+  return open + body.replace(/(\n\s*)$/, '\n    <param name="onload" value="false"/>$1') + close;
+});
+
+if (updated !== config) {
+  fs.writeFileSync(configPath, updated);
+}